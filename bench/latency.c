@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+	Open-loop latency benchmark.
+
+	Producers do not wait for the previous element before sending the next one: each producer follows a fixed schedule (the
+	arrival rate is split among them), so a stall in the queue delays the elements that should have been sent meanwhile
+	instead of silently reducing the offered load (coordinated omission).
+
+	Every element records its scheduled send time and the time 'blocking_queue_put' was actually called. When it is taken,
+	two sojourn times are recorded:
+	* sojourn: from the scheduled send time until 'blocking_queue_take' returns (includes the time the producer was late)
+	* sojourn_from_put: from the 'blocking_queue_put' call until 'blocking_queue_take' returns
+
+	Using C_FEK_BLOCKING_QUEUE_WAIT_HOOK, the time each call spends waiting for its fair lock (add_lock_wait/get_lock_wait)
+	is recorded separately from the time it spends waiting for the queue to become non-full/non-empty (not_full_wait/
+	not_empty_wait).
+
+	All values go to HDR-style histograms (log-linear buckets, ~1% precision). Each line of the output is:
+	metric,count,mean_ns,p50_ns,p90_ns,p99_ns,p99.9_ns,p99.99_ns,max_ns
+
+	usage: latency <num_producer_threads> <num_consumer_threads> <elements_per_second> <duration_ms> [capacity]
+*/
+
+// Histogram with 2^(HISTOGRAM_SUB_BUCKET_BITS - 1) linear sub-buckets per power of two
+#define HISTOGRAM_SUB_BUCKET_BITS 8
+#define HISTOGRAM_HALF_SUB_BUCKETS (1u << (HISTOGRAM_SUB_BUCKET_BITS - 1))
+#define HISTOGRAM_LENGTH ((66 - HISTOGRAM_SUB_BUCKET_BITS) * HISTOGRAM_HALF_SUB_BUCKETS)
+
+typedef struct {
+	unsigned long long counts[HISTOGRAM_LENGTH];
+	unsigned long long total_count;
+	unsigned long long sum;
+	unsigned long long max;
+} Histogram;
+
+static unsigned int histogram_index(unsigned long long value) {
+	if (value < (1ull << HISTOGRAM_SUB_BUCKET_BITS)) {
+		return (unsigned int)value;
+	}
+	unsigned int shift = (63 - __builtin_clzll(value)) - (HISTOGRAM_SUB_BUCKET_BITS - 1);
+	return shift * HISTOGRAM_HALF_SUB_BUCKETS + (unsigned int)(value >> shift);
+}
+
+// Returns the highest value that falls into the bucket 'index'
+static unsigned long long histogram_value(unsigned int index) {
+	if (index < (1u << HISTOGRAM_SUB_BUCKET_BITS)) {
+		return index;
+	}
+	unsigned int shift = index / HISTOGRAM_HALF_SUB_BUCKETS - 1;
+	unsigned long long sub_bucket = index - shift * HISTOGRAM_HALF_SUB_BUCKETS;
+	return ((sub_bucket + 1) << shift) - 1;
+}
+
+static void histogram_record(Histogram* h, unsigned long long value) {
+	++h->counts[histogram_index(value)];
+	++h->total_count;
+	h->sum += value;
+	if (value > h->max) {
+		h->max = value;
+	}
+}
+
+static void histogram_merge(Histogram* dst, const Histogram* src) {
+	for (unsigned int i = 0; i < HISTOGRAM_LENGTH; ++i) {
+		dst->counts[i] += src->counts[i];
+	}
+	dst->total_count += src->total_count;
+	dst->sum += src->sum;
+	if (src->max > dst->max) {
+		dst->max = src->max;
+	}
+}
+
+static unsigned long long histogram_percentile(const Histogram* h, double percentile) {
+	unsigned long long target = (unsigned long long)(h->total_count * percentile / 100.0 + 0.5);
+	if (target == 0) {
+		target = 1;
+	}
+	unsigned long long seen = 0;
+	for (unsigned int i = 0; i < HISTOGRAM_LENGTH; ++i) {
+		seen += h->counts[i];
+		if (seen >= target) {
+			unsigned long long value = histogram_value(i);
+			return value < h->max ? value : h->max;
+		}
+	}
+	return h->max;
+}
+
+static void histogram_print(const char* metric, const Histogram* h) {
+	printf("%s,%llu,%.0f,%llu,%llu,%llu,%llu,%llu,%llu\n", metric, h->total_count,
+		h->total_count ? (double)h->sum / h->total_count : 0.0, histogram_percentile(h, 50.0), histogram_percentile(h, 90.0),
+		histogram_percentile(h, 99.0), histogram_percentile(h, 99.9), histogram_percentile(h, 99.99), h->max);
+}
+
+// Histograms of a single thread (no synchronization is needed to record)
+typedef struct {
+	Histogram sojourn;
+	Histogram sojourn_from_put;
+	// Indexed by BQ_WAIT_*
+	Histogram waits[4];
+} Thread_Histograms;
+
+static __thread Thread_Histograms* thread_histograms;
+
+static void record_wait(int kind, unsigned long long ns) {
+	histogram_record(&thread_histograms->waits[kind], ns);
+}
+
+#define C_FEK_BLOCKING_QUEUE_IMPLEMENTATION
+#define C_FEK_FAIR_LOCK_IMPLEMENTATION
+#define C_FEK_BLOCKING_QUEUE_WAIT_HOOK(bq, kind, ns) record_wait(kind, ns)
+#include "../blocking_queue.h"
+
+typedef struct {
+	unsigned long long scheduled_ns;
+	unsigned long long put_ns;
+} Element;
+
+static Blocking_Queue bq;
+
+static unsigned int num_producer_threads;
+static unsigned int num_consumer_threads;
+static unsigned long long elements_per_producer;
+static unsigned long long interval_ns;
+static unsigned long long start_ns;
+
+static Element* elements;
+static Thread_Histograms* producer_histograms;
+static Thread_Histograms* consumer_histograms;
+static unsigned int* producer_threads_ids;
+static unsigned int* consumer_threads_ids;
+static pthread_t* producer_threads;
+static pthread_t* consumer_threads;
+
+static unsigned long long now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+static void sleep_until_ns(unsigned long long deadline_ns) {
+	struct timespec ts;
+	ts.tv_sec = deadline_ns / 1000000000ull;
+	ts.tv_nsec = deadline_ns % 1000000000ull;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+static void* producer(void* arg) {
+	unsigned int id = *(unsigned int*)arg;
+	thread_histograms = &producer_histograms[id];
+	Element* my_elements = elements + id * elements_per_producer;
+
+	// Producers are staggered, so together they send at the requested rate
+	unsigned long long scheduled_ns = start_ns + id * (interval_ns / num_producer_threads);
+	for (unsigned long long i = 0; i < elements_per_producer; ++i) {
+		if (now_ns() < scheduled_ns) {
+			sleep_until_ns(scheduled_ns);
+		}
+		my_elements[i].scheduled_ns = scheduled_ns;
+		my_elements[i].put_ns = now_ns();
+		if (blocking_queue_put(&bq, &my_elements[i])) {
+			fprintf(stderr, "put failed\n");
+			exit(1);
+		}
+		scheduled_ns += interval_ns;
+	}
+	return NULL;
+}
+
+static void* consumer(void* arg) {
+	unsigned int id = *(unsigned int*)arg;
+	thread_histograms = &consumer_histograms[id];
+
+	while (1) {
+		Element* element;
+		if (blocking_queue_take(&bq, &element)) {
+			fprintf(stderr, "take failed\n");
+			exit(1);
+		}
+		if (element == NULL) {
+			// Sent by the main thread after all producers finished
+			break;
+		}
+		unsigned long long taken_ns = now_ns();
+		histogram_record(&thread_histograms->sojourn, taken_ns - element->scheduled_ns);
+		histogram_record(&thread_histograms->sojourn_from_put, taken_ns - element->put_ns);
+	}
+	return NULL;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 5 && argc != 6) {
+		printf("usage: %s <num_producer_threads> <num_consumer_threads> <elements_per_second> <duration_ms> [capacity]\n", argv[0]);
+		return -1;
+	}
+
+	num_producer_threads = atoi(argv[1]);
+	num_consumer_threads = atoi(argv[2]);
+	unsigned long long rate = strtoull(argv[3], NULL, 10);
+	unsigned long long duration_ms = strtoull(argv[4], NULL, 10);
+	unsigned int capacity = argc == 6 ? atoi(argv[5]) : 1024;
+	if (num_producer_threads == 0 || num_consumer_threads == 0 || rate == 0) {
+		printf("number of threads and rate must be > 0\n");
+		return -1;
+	}
+
+	// Each producer sends at rate / num_producer_threads
+	interval_ns = 1000000000ull * num_producer_threads / rate;
+	elements_per_producer = rate * duration_ms / 1000 / num_producer_threads;
+	if (interval_ns == 0 || elements_per_producer == 0) {
+		printf("rate and duration must give at least one element per producer, with at most one per nanosecond\n");
+		return -1;
+	}
+
+	elements = malloc(num_producer_threads * elements_per_producer * sizeof(Element));
+	producer_histograms = calloc(num_producer_threads, sizeof(Thread_Histograms));
+	consumer_histograms = calloc(num_consumer_threads, sizeof(Thread_Histograms));
+	producer_threads_ids = malloc(num_producer_threads * sizeof(unsigned int));
+	consumer_threads_ids = malloc(num_consumer_threads * sizeof(unsigned int));
+	producer_threads = malloc(num_producer_threads * sizeof(pthread_t));
+	consumer_threads = malloc(num_consumer_threads * sizeof(pthread_t));
+	Thread_Histograms* main_histograms = calloc(1, sizeof(Thread_Histograms));
+	if (!elements || !producer_histograms || !consumer_histograms || !main_histograms) {
+		fprintf(stderr, "out of memory\n");
+		return -1;
+	}
+	thread_histograms = main_histograms;
+
+	blocking_queue_init(&bq, capacity);
+
+	// Give the threads some time to start before the first scheduled send
+	start_ns = now_ns() + 10000000ull;
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		consumer_threads_ids[i] = i;
+		if (pthread_create(&consumer_threads[i], NULL, consumer, &consumer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		producer_threads_ids[i] = i;
+		if (pthread_create(&producer_threads[i], NULL, producer, &producer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		pthread_join(producer_threads[i], NULL);
+	}
+	unsigned long long elapsed_ns = now_ns() - start_ns;
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		blocking_queue_put(&bq, NULL);
+	}
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		pthread_join(consumer_threads[i], NULL);
+	}
+
+	blocking_queue_destroy(&bq);
+
+	Thread_Histograms* total = calloc(1, sizeof(Thread_Histograms));
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		histogram_merge(&total->waits[BQ_WAIT_ADD_LOCK], &producer_histograms[i].waits[BQ_WAIT_ADD_LOCK]);
+		histogram_merge(&total->waits[BQ_WAIT_NOT_FULL], &producer_histograms[i].waits[BQ_WAIT_NOT_FULL]);
+	}
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		histogram_merge(&total->sojourn, &consumer_histograms[i].sojourn);
+		histogram_merge(&total->sojourn_from_put, &consumer_histograms[i].sojourn_from_put);
+		histogram_merge(&total->waits[BQ_WAIT_GET_LOCK], &consumer_histograms[i].waits[BQ_WAIT_GET_LOCK]);
+		histogram_merge(&total->waits[BQ_WAIT_NOT_EMPTY], &consumer_histograms[i].waits[BQ_WAIT_NOT_EMPTY]);
+	}
+
+	printf("# producers=%u consumers=%u capacity=%u offered_rate=%llu achieved_rate=%.0f\n", num_producer_threads,
+		num_consumer_threads, capacity, rate, num_producer_threads * elements_per_producer / (elapsed_ns / 1e9));
+	printf("metric,count,mean_ns,p50_ns,p90_ns,p99_ns,p99.9_ns,p99.99_ns,max_ns\n");
+	histogram_print("sojourn", &total->sojourn);
+	histogram_print("sojourn_from_put", &total->sojourn_from_put);
+	histogram_print("add_lock_wait", &total->waits[BQ_WAIT_ADD_LOCK]);
+	histogram_print("get_lock_wait", &total->waits[BQ_WAIT_GET_LOCK]);
+	histogram_print("not_full_wait", &total->waits[BQ_WAIT_NOT_FULL]);
+	histogram_print("not_empty_wait", &total->waits[BQ_WAIT_NOT_EMPTY]);
+
+	free(elements);
+	free(producer_histograms);
+	free(consumer_histograms);
+	free(main_histograms);
+	free(total);
+	free(producer_threads_ids);
+	free(consumer_threads_ids);
+	free(producer_threads);
+	free(consumer_threads);
+	return 0;
+}
@@ -0,0 +1,10 @@
+#!/bin/bash
+# Runs the open-loop latency benchmark and prints its histograms as CSV. Arguments are forwarded to the benchmark, e.g.:
+#   ./latency.sh 4 4 100000 1000 1024
+BASE_DIR=$(dirname "$0")
+BIN_DIR=bin
+pushd $BASE_DIR > /dev/null
+mkdir -p $BIN_DIR
+gcc -o $BIN_DIR/latency latency.c -lpthread -Wall -O2 -g
+./$BIN_DIR/latency "$@"
+popd > /dev/null
@@ -0,0 +1,192 @@
+#define _GNU_SOURCE
+#define C_FEK_BLOCKING_QUEUE_IMPLEMENTATION
+#define C_FEK_FAIR_LOCK_IMPLEMENTATION
+#include "../blocking_queue.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+/*
+	Cross-core layout benchmark.
+
+	Runs 'pairs' independent producer/consumer pairs, each one with its own queue. The queues are contiguous in a single array,
+	so with the default layout the end of a queue shares a cache line with the start of the next one. The producer of each pair
+	is pinned to one CPU and its consumer to another (taken round-robin from the CPUs the process may run on), so every line
+	written by both sides moves between cores.
+
+	The benchmark is built twice by layout.sh: once with the default layout and once with C_FEK_BLOCKING_QUEUE_CACHE_LINE_SIZE
+	defined. Comparing both lines of the output shows what keeping producer, consumer and shared state on separate lines buys.
+	When fewer than two CPUs are available, both threads of a pair run on the same CPU and 'cross_core' is 0: the numbers are
+	then not meaningful for this comparison.
+
+	Each run prints one CSV line:
+	layout,sizeof,pairs,capacity,mode,ops_per_pair,cross_core,seconds,ops_per_sec,cpu_ns_per_op
+
+	usage: layout [ops_per_pair] [capacity] [pairs] [mode]
+	* mode: put_take (blocking calls) or add_poll (non-blocking calls, retried with sched_yield)
+*/
+
+#define MAX_PAIRS 64
+
+#if defined(C_FEK_BLOCKING_QUEUE_CACHE_LINE_SIZE)
+#define STRINGIFY(x) #x
+#define TO_STRING(x) STRINGIFY(x)
+#define LAYOUT_NAME "aligned" TO_STRING(C_FEK_BLOCKING_QUEUE_CACHE_LINE_SIZE)
+#else
+#define LAYOUT_NAME "packed"
+#endif
+
+static Blocking_Queue queues[MAX_PAIRS];
+
+static int async;
+static unsigned long long ops;
+// CPUs the process may run on
+static int* cpus;
+static unsigned int num_cpus;
+// Sum of the elements taken, so the consumers' work is not optimized away
+static unsigned long long checksum;
+
+static void pin_to_cpu(unsigned int index) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpus[index % num_cpus], &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+		fprintf(stderr, "warning: could not pin thread to cpu %d\n", cpus[index % num_cpus]);
+	}
+}
+
+static void* producer(void* arg) {
+	unsigned int pair = *(unsigned int*)arg;
+	Blocking_Queue* bq = &queues[pair];
+	pin_to_cpu(2 * pair);
+
+	for (unsigned long long i = 0; i < ops; ++i) {
+		void* element = (void*)(i + 1);
+		if (async) {
+			int ret;
+			while ((ret = blocking_queue_add(bq, element)) == BQ_FULL) {
+				sched_yield();
+			}
+			if (ret) {
+				fprintf(stderr, "add failed: %d\n", ret);
+				exit(1);
+			}
+		} else if (blocking_queue_put(bq, element)) {
+			fprintf(stderr, "put failed\n");
+			exit(1);
+		}
+	}
+	return NULL;
+}
+
+static void* consumer(void* arg) {
+	unsigned int pair = *(unsigned int*)arg;
+	Blocking_Queue* bq = &queues[pair];
+	unsigned long long local_checksum = 0;
+	pin_to_cpu(2 * pair + 1);
+
+	for (unsigned long long i = 0; i < ops; ++i) {
+		void* element;
+		if (async) {
+			int ret;
+			while ((ret = blocking_queue_poll(bq, &element)) == BQ_EMPTY) {
+				sched_yield();
+			}
+			if (ret) {
+				fprintf(stderr, "poll failed: %d\n", ret);
+				exit(1);
+			}
+		} else if (blocking_queue_take(bq, &element)) {
+			fprintf(stderr, "take failed\n");
+			exit(1);
+		}
+		local_checksum += (unsigned long long)element;
+	}
+	__atomic_add_fetch(&checksum, local_checksum, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+static unsigned long long now_ns(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+static int load_cpus() {
+	cpu_set_t set;
+	if (sched_getaffinity(0, sizeof(set), &set)) {
+		fprintf(stderr, "error getting cpu affinity: %s\n", strerror(errno));
+		return -1;
+	}
+	cpus = malloc(CPU_SETSIZE * sizeof(int));
+	num_cpus = 0;
+	for (int i = 0; i < CPU_SETSIZE; ++i) {
+		if (CPU_ISSET(i, &set)) {
+			cpus[num_cpus++] = i;
+		}
+	}
+	return num_cpus ? 0 : -1;
+}
+
+int main(int argc, char** argv) {
+	ops = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+	unsigned int capacity = argc > 2 ? (unsigned int)atoi(argv[2]) : 1024;
+	unsigned int pairs = argc > 3 ? (unsigned int)atoi(argv[3]) : 1;
+	const char* mode = argc > 4 ? argv[4] : "add_poll";
+	async = !strcmp(mode, "add_poll");
+
+	if (ops == 0 || pairs == 0 || pairs > MAX_PAIRS || (!async && strcmp(mode, "put_take"))) {
+		printf("usage: %s [ops_per_pair] [capacity] [pairs (1-%d)] [put_take|add_poll]\n", argv[0], MAX_PAIRS);
+		return -1;
+	}
+	if (load_cpus()) {
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < pairs; ++i) {
+		if (blocking_queue_init(&queues[i], capacity)) {
+			fprintf(stderr, "error initializing queue\n");
+			return -1;
+		}
+	}
+
+	pthread_t* threads = malloc(2 * pairs * sizeof(pthread_t));
+	unsigned int* ids = malloc(pairs * sizeof(unsigned int));
+
+	unsigned long long wall_start = now_ns(CLOCK_MONOTONIC);
+	unsigned long long cpu_start = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+	for (unsigned int i = 0; i < pairs; ++i) {
+		ids[i] = i;
+		if (pthread_create(&threads[2 * i], NULL, consumer, &ids[i]) ||
+			pthread_create(&threads[2 * i + 1], NULL, producer, &ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+	for (unsigned int i = 0; i < 2 * pairs; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+	unsigned long long wall_ns = now_ns(CLOCK_MONOTONIC) - wall_start;
+	unsigned long long cpu_ns = now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+	unsigned long long total_ops = ops * pairs;
+
+	for (unsigned int i = 0; i < pairs; ++i) {
+		blocking_queue_destroy(&queues[i]);
+	}
+	free(threads);
+	free(ids);
+	free(cpus);
+
+	if (checksum != pairs * (ops * (ops + 1) / 2)) {
+		fprintf(stderr, "wrong checksum\n");
+		return -1;
+	}
+
+	printf("layout,sizeof,pairs,capacity,mode,ops_per_pair,cross_core,seconds,ops_per_sec,cpu_ns_per_op\n");
+	printf("%s,%zu,%u,%u,%s,%llu,%d,%.6f,%.0f,%.1f\n", LAYOUT_NAME, sizeof(Blocking_Queue), pairs, capacity, mode, ops,
+		num_cpus > 1, wall_ns / 1e9, total_ops / (wall_ns / 1e9), (double)cpu_ns / total_ops);
+	return 0;
+}
@@ -0,0 +1,14 @@
+#!/bin/bash
+# Builds the cross-core layout benchmark with the default layout and with C_FEK_BLOCKING_QUEUE_CACHE_LINE_SIZE, and runs both.
+# Arguments are forwarded to the benchmark, e.g.:
+#   ./layout.sh 1000000 1024 2 add_poll
+BASE_DIR=$(dirname "$0")
+BIN_DIR=bin
+LINE_SIZE=${LINE_SIZE:-64}
+pushd $BASE_DIR > /dev/null
+mkdir -p $BIN_DIR
+gcc -o $BIN_DIR/layout_packed layout.c -lpthread -Wall -O2 -g
+gcc -o $BIN_DIR/layout_aligned layout.c -DC_FEK_BLOCKING_QUEUE_CACHE_LINE_SIZE=$LINE_SIZE -lpthread -Wall -O2 -g
+./$BIN_DIR/layout_packed "$@"
+./$BIN_DIR/layout_aligned "$@" | tail -n 1
+popd > /dev/null
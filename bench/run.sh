@@ -0,0 +1,11 @@
+#!/bin/bash
+# Runs the throughput matrix and prints it as CSV. Arguments are forwarded to the benchmark, e.g.:
+#   ./run.sh 1000000 bq put_take 4 4 1024 ptr
+#   ./run.sh 100000 '*' '*' 1 1
+BASE_DIR=$(dirname "$0")
+BIN_DIR=bin
+pushd $BASE_DIR > /dev/null
+mkdir -p $BIN_DIR
+gcc -o $BIN_DIR/throughput throughput.c -lpthread -Wall -O2 -g
+./$BIN_DIR/throughput "$@"
+popd > /dev/null
@@ -0,0 +1,391 @@
+#define C_FEK_BLOCKING_QUEUE_IMPLEMENTATION
+#define C_FEK_FAIR_LOCK_IMPLEMENTATION
+#define C_FEK_SPSC_BLOCKING_QUEUE_IMPLEMENTATION
+#define C_FEK_MPMC_BLOCKING_QUEUE_IMPLEMENTATION
+#define C_FEK_TICKET_BLOCKING_QUEUE_IMPLEMENTATION
+#include "../blocking_queue.h"
+#include "../spsc_blocking_queue.h"
+#include "../mpmc_blocking_queue.h"
+#include "../ticket_blocking_queue.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+/*
+	Throughput benchmark.
+
+	Every case moves a fixed number of elements from the producer threads to the consumer threads and reports, as one CSV line:
+	the wall-clock throughput and the CPU time (user + system, summed over all threads) spent per element.
+
+	usage: throughput [ops_per_case] [impl] [mode] [producers] [consumers] [capacity] [payload]
+
+	Without the optional arguments, the whole matrix is run. Any argument may be '*' to sweep all its values.
+	* impl: bq (blocking_queue.h), naive (mutex + cond ring, the baseline), spsc, mpmc, ticket
+	* mode: put_take (blocking calls) or add_poll (non-blocking calls, retried with sched_yield)
+	* capacity: 0 means boundless (only supported by bq and naive)
+	* payload: ptr (the element is the pointer itself), alloc64/alloc4096 (the producer allocates and fills a buffer, the consumer
+	  reads and frees it)
+*/
+
+#define NAIVE_OK 0
+
+// Naive baseline: a ring protected by a single mutex, with one cond for "not empty" and one for "not full".
+// No FIFO guarantee for blocked callers, no close support.
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t not_empty_cond;
+	pthread_cond_t not_full_cond;
+	void** queue;
+	unsigned int queue_capacity;
+	unsigned int queue_size;
+	unsigned int queue_front;
+	int is_boundless;
+} Naive_Queue;
+
+static int naive_queue_init(Naive_Queue* q, unsigned int capacity) {
+	pthread_mutex_init(&q->mutex, NULL);
+	pthread_cond_init(&q->not_empty_cond, NULL);
+	pthread_cond_init(&q->not_full_cond, NULL);
+	q->is_boundless = capacity == 0;
+	q->queue_capacity = capacity ? capacity : 1;
+	q->queue_size = 0;
+	q->queue_front = 0;
+	q->queue = malloc(q->queue_capacity * sizeof(void*));
+	return q->queue == NULL ? -1 : 0;
+}
+
+static void naive_queue_destroy(Naive_Queue* q) {
+	free(q->queue);
+	pthread_mutex_destroy(&q->mutex);
+	pthread_cond_destroy(&q->not_empty_cond);
+	pthread_cond_destroy(&q->not_full_cond);
+}
+
+static int naive_queue_grow(Naive_Queue* q) {
+	void** new_queue = malloc(2 * q->queue_capacity * sizeof(void*));
+	if (new_queue == NULL) {
+		return -1;
+	}
+	for (unsigned int i = 0; i < q->queue_size; ++i) {
+		new_queue[i] = q->queue[(q->queue_front + i) % q->queue_capacity];
+	}
+	free(q->queue);
+	q->queue = new_queue;
+	q->queue_capacity *= 2;
+	q->queue_front = 0;
+	return 0;
+}
+
+static int naive_queue_add_internal(Naive_Queue* q, void* element, int async) {
+	pthread_mutex_lock(&q->mutex);
+	if (q->is_boundless && q->queue_size == q->queue_capacity && naive_queue_grow(q)) {
+		pthread_mutex_unlock(&q->mutex);
+		return BQ_ERROR;
+	}
+	while (q->queue_size == q->queue_capacity) {
+		if (async) {
+			pthread_mutex_unlock(&q->mutex);
+			return BQ_FULL;
+		}
+		pthread_cond_wait(&q->not_full_cond, &q->mutex);
+	}
+	q->queue[(q->queue_front + q->queue_size) % q->queue_capacity] = element;
+	++q->queue_size;
+	pthread_cond_signal(&q->not_empty_cond);
+	pthread_mutex_unlock(&q->mutex);
+	return NAIVE_OK;
+}
+
+static int naive_queue_get_internal(Naive_Queue* q, void** element, int async) {
+	pthread_mutex_lock(&q->mutex);
+	while (q->queue_size == 0) {
+		if (async) {
+			pthread_mutex_unlock(&q->mutex);
+			return BQ_EMPTY;
+		}
+		pthread_cond_wait(&q->not_empty_cond, &q->mutex);
+	}
+	*element = q->queue[q->queue_front];
+	q->queue_front = (q->queue_front + 1) % q->queue_capacity;
+	--q->queue_size;
+	pthread_cond_signal(&q->not_full_cond);
+	pthread_mutex_unlock(&q->mutex);
+	return NAIVE_OK;
+}
+
+static int naive_queue_put(Naive_Queue* q, void* element) {
+	return naive_queue_add_internal(q, element, 0);
+}
+
+static int naive_queue_add(Naive_Queue* q, void* element) {
+	return naive_queue_add_internal(q, element, 1);
+}
+
+static int naive_queue_take(Naive_Queue* q, void* element) {
+	return naive_queue_get_internal(q, (void**)element, 0);
+}
+
+static int naive_queue_poll(Naive_Queue* q, void* element) {
+	return naive_queue_get_internal(q, (void**)element, 1);
+}
+
+// Uniform interface over all the implementations
+typedef struct {
+	const char* name;
+	int supports_boundless;
+	int single_producer_single_consumer;
+	int (*init)(void* q, unsigned int capacity);
+	void (*destroy)(void* q);
+	int (*put)(void* q, void* element);
+	int (*add)(void* q, void* element);
+	int (*take)(void* q, void* element);
+	int (*poll)(void* q, void* element);
+} Bench_Impl;
+
+#define BENCH_IMPL(prefix, supports_boundless, spsc) \
+	{ #prefix, supports_boundless, spsc, \
+		(int (*)(void*, unsigned int))prefix##_init, (void (*)(void*))prefix##_destroy, \
+		(int (*)(void*, void*))prefix##_put, (int (*)(void*, void*))prefix##_add, \
+		(int (*)(void*, void*))prefix##_take, (int (*)(void*, void*))prefix##_poll }
+
+static const Bench_Impl impls[] = {
+	BENCH_IMPL(blocking_queue, 1, 0),
+	BENCH_IMPL(naive_queue, 1, 0),
+	BENCH_IMPL(spsc_blocking_queue, 0, 1),
+	BENCH_IMPL(mpmc_blocking_queue, 0, 0),
+	BENCH_IMPL(ticket_blocking_queue, 0, 0),
+};
+static const char* impl_names[] = { "bq", "naive", "spsc", "mpmc", "ticket" };
+
+static const char* modes[] = { "put_take", "add_poll" };
+static const unsigned int thread_counts[][2] = { {1, 1}, {1, 4}, {4, 1}, {4, 4}, {16, 16} };
+static const unsigned int capacities[] = { 2, 64, 1024, 0 };
+static const char* payloads[] = { "ptr", "alloc64", "alloc4096" };
+static const unsigned int payload_sizes[] = { 0, 64, 4096 };
+
+#define ARRAY_LENGTH(a) (sizeof(a) / sizeof((a)[0]))
+
+// Enough storage for any of the queues
+static union {
+	Blocking_Queue bq;
+	Naive_Queue naive;
+	Spsc_Blocking_Queue spsc;
+	Mpmc_Blocking_Queue mpmc;
+	Ticket_Blocking_Queue ticket;
+} queue_storage;
+
+static const Bench_Impl* impl;
+static int async;
+static unsigned int payload_size;
+static unsigned long long ops;
+static unsigned int num_producer_threads;
+static unsigned int num_consumer_threads;
+// Number of elements that were not claimed by a consumer yet
+static long long remaining;
+// Sum of the bytes read by consumers, so the reads are not optimized away
+static unsigned long long checksum;
+
+static void* producer(void* arg) {
+	unsigned int id = *(unsigned int*)arg;
+	unsigned long long count = ops / num_producer_threads + (id < ops % num_producer_threads ? 1 : 0);
+	void* q = &queue_storage;
+
+	for (unsigned long long i = 0; i < count; ++i) {
+		void* element = (void*)(i + 1);
+		if (payload_size) {
+			unsigned char* buffer = malloc(payload_size);
+			memset(buffer, (int)(i & 0xFF), payload_size);
+			element = buffer;
+		}
+		if (async) {
+			int ret;
+			while ((ret = impl->add(q, element)) == BQ_FULL) {
+				sched_yield();
+			}
+			if (ret) {
+				fprintf(stderr, "add failed: %d\n", ret);
+				exit(1);
+			}
+		} else if (impl->put(q, element)) {
+			fprintf(stderr, "put failed\n");
+			exit(1);
+		}
+	}
+	return NULL;
+}
+
+static void* consumer(void* arg) {
+	void* q = &queue_storage;
+	unsigned long long local_checksum = 0;
+
+	while (__atomic_sub_fetch(&remaining, 1, __ATOMIC_RELAXED) >= 0) {
+		void* element;
+		if (async) {
+			int ret;
+			while ((ret = impl->poll(q, &element)) == BQ_EMPTY) {
+				sched_yield();
+			}
+			if (ret) {
+				fprintf(stderr, "poll failed: %d\n", ret);
+				exit(1);
+			}
+		} else if (impl->take(q, &element)) {
+			fprintf(stderr, "take failed\n");
+			exit(1);
+		}
+		if (payload_size) {
+			unsigned char* buffer = element;
+			for (unsigned int i = 0; i < payload_size; i += 64) {
+				local_checksum += buffer[i];
+			}
+			free(buffer);
+		} else {
+			local_checksum += (unsigned long long)element;
+		}
+	}
+	__atomic_add_fetch(&checksum, local_checksum, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+static unsigned long long now_ns(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+static int run_case(unsigned int impl_index, unsigned int mode, unsigned int producers, unsigned int consumers,
+	unsigned int capacity, unsigned int payload) {
+	impl = &impls[impl_index];
+	async = mode == 1;
+	payload_size = payload_sizes[payload];
+	num_producer_threads = producers;
+	num_consumer_threads = consumers;
+	remaining = (long long)ops;
+	checksum = 0;
+
+	if (capacity == 0 && !impl->supports_boundless) {
+		return 0;
+	}
+	if (impl->single_producer_single_consumer && (producers != 1 || consumers != 1)) {
+		return 0;
+	}
+
+	if (impl->init(&queue_storage, capacity)) {
+		fprintf(stderr, "error initializing %s\n", impl_names[impl_index]);
+		return -1;
+	}
+
+	pthread_t* threads = malloc((producers + consumers) * sizeof(pthread_t));
+	unsigned int* ids = malloc(producers * sizeof(unsigned int));
+
+	unsigned long long wall_start = now_ns(CLOCK_MONOTONIC);
+	unsigned long long cpu_start = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+	for (unsigned int i = 0; i < consumers; ++i) {
+		if (pthread_create(&threads[i], NULL, consumer, NULL)) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+	for (unsigned int i = 0; i < producers; ++i) {
+		ids[i] = i;
+		if (pthread_create(&threads[consumers + i], NULL, producer, &ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+	for (unsigned int i = 0; i < producers + consumers; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+	unsigned long long wall_ns = now_ns(CLOCK_MONOTONIC) - wall_start;
+	unsigned long long cpu_ns = now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+
+	impl->destroy(&queue_storage);
+	free(threads);
+	free(ids);
+
+	printf("%s,%s,%u,%u,%u,%s,%llu,%.6f,%.0f,%.1f\n", impl_names[impl_index], modes[mode], producers, consumers, capacity,
+		payloads[payload], ops, wall_ns / 1e9, ops / (wall_ns / 1e9), (double)cpu_ns / ops);
+	fflush(stdout);
+	return 0;
+}
+
+// Returns the index of 'value' in 'names', -1 for '*' (or a missing argument) and -2 if not found
+static int parse_name(int argc, char** argv, int index, const char** names, unsigned int count) {
+	if (index >= argc || !strcmp(argv[index], "*")) {
+		return -1;
+	}
+	for (unsigned int i = 0; i < count; ++i) {
+		if (!strcmp(argv[index], names[i])) {
+			return (int)i;
+		}
+	}
+	return -2;
+}
+
+// Returns the parsed number, or -1 for '*' (or a missing argument)
+static long long parse_number(int argc, char** argv, int index) {
+	if (index >= argc || !strcmp(argv[index], "*")) {
+		return -1;
+	}
+	return atoll(argv[index]);
+}
+
+int main(int argc, char** argv) {
+	ops = argc > 1 ? strtoull(argv[1], NULL, 10) : 100000;
+	int impl_filter = parse_name(argc, argv, 2, impl_names, ARRAY_LENGTH(impl_names));
+	int mode_filter = parse_name(argc, argv, 3, modes, ARRAY_LENGTH(modes));
+	long long producers_filter = parse_number(argc, argv, 4);
+	long long consumers_filter = parse_number(argc, argv, 5);
+	long long capacity_filter = parse_number(argc, argv, 6);
+	int payload_filter = parse_name(argc, argv, 7, payloads, ARRAY_LENGTH(payloads));
+
+	if (ops == 0 || impl_filter == -2 || mode_filter == -2 || payload_filter == -2) {
+		printf("usage: %s [ops_per_case] [impl] [mode] [producers] [consumers] [capacity] [payload]\n", argv[0]);
+		return -1;
+	}
+
+	// When both thread counts are given, they do not need to be part of the predefined sweep
+	unsigned int custom_thread_counts[1][2];
+	const unsigned int (*threads)[2] = thread_counts;
+	unsigned int threads_length = ARRAY_LENGTH(thread_counts);
+	if (producers_filter > 0 && consumers_filter > 0) {
+		custom_thread_counts[0][0] = (unsigned int)producers_filter;
+		custom_thread_counts[0][1] = (unsigned int)consumers_filter;
+		threads = (const unsigned int (*)[2])custom_thread_counts;
+		threads_length = 1;
+	}
+
+	printf("impl,mode,producers,consumers,capacity,payload,ops,seconds,ops_per_sec,cpu_ns_per_op\n");
+	for (unsigned int i = 0; i < ARRAY_LENGTH(impls); ++i) {
+		if (impl_filter >= 0 && impl_filter != (int)i) continue;
+		for (unsigned int m = 0; m < ARRAY_LENGTH(modes); ++m) {
+			if (mode_filter >= 0 && mode_filter != (int)m) continue;
+			for (unsigned int t = 0; t < threads_length; ++t) {
+				if (producers_filter >= 0 && producers_filter != threads[t][0]) continue;
+				if (consumers_filter >= 0 && consumers_filter != threads[t][1]) continue;
+				for (unsigned int c = 0; c < ARRAY_LENGTH(capacities); ++c) {
+					unsigned int capacity = capacities[c];
+					if (capacity_filter >= 0) {
+						if (c > 0) break;
+						capacity = (unsigned int)capacity_filter;
+					}
+					for (unsigned int p = 0; p < ARRAY_LENGTH(payloads); ++p) {
+						if (payload_filter >= 0 && payload_filter != (int)p) continue;
+						if (run_case(i, m, threads[t][0], threads[t][1], capacity, p)) {
+							return -1;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// Keeps the consumers' reads alive
+	if (checksum == 42) {
+		fprintf(stderr, "\n");
+	}
+	return 0;
+}
@@ -41,8 +41,16 @@
 	- It allows the caller to add elements to the queue via both a blocking call and a non-blocking call.
 	- It allows the caller to get elements from the queue via both a blocking call and a non-blocking call.
 	- If multiple callers are blocked adding/getting an element to/from the queue, they are served in FIFO order.
-	
-	The last point avoids the problem of starvation.
+	  This avoids the problem of starvation.
+	- It allows the caller to add/get multiple elements in a single call ('_n' variants), paying for the locking only once per batch.
+	- It can optionally spin for a while before parking blocked callers (see 'blocking_queue_init_with_options').
+	- Typed queues that store elements by value can be generated with 'BQ_DEFINE' (no allocation per element).
+	- Fixed-size records can also be stored by value with a size chosen at runtime (see 'blocking_queue_init_sized').
+	- Elements can be written/read in place, directly in the queue's storage (see 'blocking_queue_reserve_put').
+	- Boundless queues grow one segment at a time and give memory back after bursts (see 'blocking_queue_get_footprint').
+	- Non-blocking calls on a full/empty/closed queue fail right away, without taking any lock.
+	- Blocking calls can give up after a timeout or at a deadline (see 'blocking_queue_put_timed').
+	- Consumers can take elements in batches that linger for more elements, up to a size or a time limit (see 'blocking_queue_take_batch').
 
 	Note that since the queue is designed to serve callers in FIFO order, this might have a significant impact in performance.
 
@@ -55,6 +63,35 @@
 	void  free(void* block)
 	void* memcpy (void* dest, const void* src, unsigned int n)
 
+	To allocate the memory of a queue with something else than the C Runtime Library (an arena, a pool, etc.) in a per-queue basis,
+	set 'allocator' in 'Blocking_Queue_Options'.
+
+	Define C_FEK_BLOCKING_QUEUE_WAIT_HOOK(bq, kind, ns) before including blocking_queue.h (in the source file with the implementation)
+	to be notified of how long callers wait. It is invoked, in the caller's thread, after every wait for the fair lock
+	(kind BQ_WAIT_ADD_LOCK/BQ_WAIT_GET_LOCK) and after every wait for the queue to become non-full/non-empty (kind
+	BQ_WAIT_NOT_FULL/BQ_WAIT_NOT_EMPTY). 'ns' is the time waited, in nanoseconds. When the hook is not defined, nothing is measured.
+
+	Define C_FEK_BLOCKING_QUEUE_USDT to compile static tracepoints (USDT probes, requires <sys/sdt.h> from systemtap-sdt-dev) into
+	the implementation. They are a single nop when nobody is tracing, and can be attached to with perf or bpftrace without
+	rebuilding. The probes (provider 'c_fek_blocking_queue') are:
+	* enqueue(bq, first_element, n, queue_size): 'n' elements were added; 'queue_size' is the size after adding them
+	* dequeue(bq, first_element, n, queue_size): 'n' elements were taken; 'queue_size' is the size after taking them
+	  ('first_element' is the address of the caller's copy of the first element, e.g. a 'void**' for the 'void*' API)
+	  (for reserve/commit and acquire/release, it is the address of the slot in the queue)
+	* block(bq, is_adding): a caller is about to wait because the queue is full (is_adding = 1) or empty (is_adding = 0)
+	* unblock(bq, is_adding): the caller stopped waiting
+	* grow(bq, segments_count): a boundless queue linked a new segment; 'segments_count' is the number of segments allocated
+	* close(bq) and destroy(bq)
+	Define C_FEK_FAIR_LOCK_USDT as well to also trace the fair locks (see fair_lock.h).
+	When C_FEK_BLOCKING_QUEUE_USDT is not defined, the probes are not compiled at all.
+
+	Define C_FEK_BLOCKING_QUEUE_CACHE_LINE_SIZE (e.g. 64, or 128 where the adjacent line is prefetched as a pair) to align the
+	fields written by producers, by consumers and by both sides to separate cache lines, so producers and consumers running on
+	different cores do not invalidate each other's lines when they touch only their own state. 'Blocking_Queue' then has that
+	alignment and its size is a multiple of it, so it can be embedded in other aligned structures without sharing a line with
+	their fields. It changes the layout of the structure, so it must have the same value in every source file including
+	blocking_queue.h, and queues allocated on the heap must use an aligned allocation (e.g. 'aligned_alloc').
+
 	For more information about the API, check the comments in the function signatures.
 
 	An usage example:
@@ -124,39 +161,214 @@
 #define BQ_FULL 2
 #define BQ_EMPTY 3
 #define BQ_CLOSED 4
+#define BQ_TIMEOUT 5
+
+// Number of elements per segment of a boundless queue, unless 'segment_capacity' is set (see 'Blocking_Queue_Options')
+#define BQ_DEFAULT_SEGMENT_CAPACITY 1024
+// Shrink policy of boundless queues (see 'blocking_queue_get_footprint')
+#define BQ_SHRINK_OCCUPANCY_RATIO 4
+#define BQ_SHRINK_DELAY 16
+
+// Kinds of waits reported to C_FEK_BLOCKING_QUEUE_WAIT_HOOK
+#define BQ_WAIT_ADD_LOCK 0
+#define BQ_WAIT_GET_LOCK 1
+#define BQ_WAIT_NOT_FULL 2
+#define BQ_WAIT_NOT_EMPTY 3
+
+// Options that can be provided to 'blocking_queue_init_with_options'. A zeroed structure gives the default behavior.
+typedef struct {
+	// How blocked callers spin before parking. Applies both when waiting for the queue to become non-empty/non-full and when waiting
+	// for the turn in the FIFO of callers. A zeroed policy means callers park immediately.
+	Fair_Lock_Spin_Policy spin_policy;
+	// If true, the queue collects the statistics reported by 'blocking_queue_get_stats'.
+	int collect_stats;
+	// If true, a fixed capacity is rounded up to the next power of two, so indexes are wrapped with a mask instead of '%'.
+	// (This is always the case if the capacity is already a power of two, and for boundless queues.)
+	int power_of_two_capacity;
+	// Number of elements per segment of a boundless queue (see 'blocking_queue_init'). 0 means BQ_DEFAULT_SEGMENT_CAPACITY.
+	unsigned int segment_capacity;
+	// Allocator for the memory of the queue (its buffer or segments) and of its fair locks, e.g. an arena or a pool bound to a
+	// NUMA node. A zeroed allocator means the C Runtime Library. The allocator is copied.
+	Fair_Lock_Allocator allocator;
+	// Number of callers adding (and, separately, getting) elements that can be in the queue at the same time without allocating
+	// memory: the structures they need to wait for their turn are preallocated (see 'fair_lock_init_with_capacity').
+	unsigned int preallocated_waiters;
+} Blocking_Queue_Options;
+
+// Spin statistics, filled by 'blocking_queue_get_spin_stats'.
+// A spin succeeds when the caller could proceed before its spin budget was exhausted, avoiding a sleep/wake-up cycle.
+typedef struct {
+	// Number of spins that succeeded/failed while waiting for the queue to become non-empty (take) or non-full (put)
+	unsigned long long wait_spin_successes;
+	unsigned long long wait_spin_failures;
+	// Number of spins that succeeded/failed while waiting for the turn in the FIFO of callers (both add and get sides)
+	unsigned long long lock_spin_successes;
+	unsigned long long lock_spin_failures;
+} Blocking_Queue_Spin_Stats;
+
+// Wake-up statistics, filled by 'blocking_queue_get_wakeup_stats'.
+typedef struct {
+	// Number of times a blocked counterpart (producer waiting for space or consumer waiting for elements) was signaled
+	unsigned long long wakeups_signaled;
+	// Number of times the signal was skipped because no counterpart was blocked
+	unsigned long long wakeups_elided;
+} Blocking_Queue_Wakeup_Stats;
+
+// Statistics snapshot, filled by 'blocking_queue_get_stats'.
+// Unless the queue was created with 'collect_stats', only 'max_add_lock_waiting_threads', 'max_get_lock_waiting_threads', 'spin'
+// and 'wakeups' are filled (the other counters stay 0).
+typedef struct {
+	// Number of elements added/taken
+	unsigned long long puts;
+	unsigned long long takes;
+	// Number of non-blocking calls that returned BQ_FULL/BQ_EMPTY
+	unsigned long long full_rejections;
+	unsigned long long empty_rejections;
+	// Number of times a boundless queue had to grow (link a new segment)
+	unsigned long long grow_events;
+	// Number of times a boundless queue gave spare segments back to the allocator (automatically or via 'blocking_queue_trim')
+	unsigned long long shrink_events;
+	// Highest number of elements that were in the queue at the same time
+	unsigned int max_queue_size;
+	// Cumulative time that callers were blocked waiting for the queue to become non-full/non-empty, in nanoseconds
+	unsigned long long not_full_blocked_ns;
+	unsigned long long not_empty_blocked_ns;
+	// Highest number of callers that were waiting for the turn in the FIFO of callers at the same time
+	int max_add_lock_waiting_threads;
+	int max_get_lock_waiting_threads;
+	Blocking_Queue_Spin_Stats spin;
+	Blocking_Queue_Wakeup_Stats wakeups;
+} Blocking_Queue_Stats;
 
 // This structure is reserved for internal-use only
+typedef struct Blocking_Queue_Segment {
+	// Next segment of the queue (or of the free list)
+	struct Blocking_Queue_Segment* next;
+	// 'segment_capacity' elements. The union keeps them as aligned as they would be in a buffer returned by malloc.
+	union {
+		long double ld;
+		long long ll;
+		void* p;
+	} elements[];
+} Blocking_Queue_Segment;
+
+#if defined(C_FEK_BLOCKING_QUEUE_CACHE_LINE_SIZE)
+#define BQ_CACHE_ALIGNED __attribute__((aligned(C_FEK_BLOCKING_QUEUE_CACHE_LINE_SIZE)))
+#else
+#define BQ_CACHE_ALIGNED
+#endif
+
+// This structure is reserved for internal-use only
+// The fields are grouped by who writes them: configuration (written only by init), producers, consumers, both sides (under
+// 'mutex') and the lifecycle of the queue. When C_FEK_BLOCKING_QUEUE_CACHE_LINE_SIZE is defined, each group starts on its own
+// cache line.
 typedef struct {
-	// Fair lock used for get operations
-	Fair_Lock get_lock;
+	// --- Configuration, read-only after init
+
+	// The queue of elements. It has a fixed size and is allocated in the init call (NULL for boundless queues).
+	// This is a circular queue. The front and the rear of the queue are given by queue_front and queue_rear
+	// Elements are stored by value, each one taking 'element_size' bytes ('sizeof(void*)' for the 'void*' API).
+	BQ_CACHE_ALIGNED unsigned char* queue;
+	// The size of each element, in bytes
+	unsigned int element_size;
+	// queue_capacity - 1 if the capacity is a power of two (so indexes can be wrapped with a mask), 0 otherwise
+	unsigned int queue_mask;
+	// The number of elements per segment (boundless queues, see 'head_segment')
+	unsigned int segment_capacity;
+	// If true, the queue does not have a maximum capacity
+	int is_boundless;
+	// If true, the queue was created with 'blocking_queue_init_sized': 'element' (in add/put) points to the record to copy
+	int is_sized;
+	// If true, 'queue' was provided by the caller (see 'blocking_queue_init_with_buffer'), so it is not freed by the queue
+	int is_buffer_borrowed;
+	// If true, the statistics counters are updated
+	int collect_stats;
+	// How blocked callers spin before waiting on 'not_empty_cond'/'not_full_cond'
+	Fair_Lock_Spin_Policy spin_policy;
+	// Allocator for 'queue' and the segments
+	Fair_Lock_Allocator allocator;
+
+	// --- Written by producers
+
 	// Fair lock used for add operations
-	Fair_Lock add_lock;
-	// Stores whether weak locks are blocked for the 'get_lock'. Used as an optimization
-	int get_lock_are_weak_locks_blocked;
+	BQ_CACHE_ALIGNED Fair_Lock add_lock;
 	// Stores whether weak locks are blocked for the 'add_lock'. Used as an optimization
 	int add_lock_are_weak_locks_blocked;
-	// Main mutex, synchronizes get/add operations.
-	pthread_mutex_t mutex;
-	// Cond used to wake up blocked callers
-	pthread_cond_t cond;
-	// The queue of elements. It has a fixed size and is allocated in the init call.
-	// This is a circular queue. The front and the rear of the queue are given by queue_front and queue_rear
-	void** queue;
-	// The capacity of the queue
-	unsigned int queue_capacity;
-	// Number of elements currently in the queue.
-	unsigned int queue_size;
-	// The front of the queue
-	unsigned int queue_front;
+	// Number of callers waiting on 'not_full_cond'. The cond is only signaled if there is a waiter.
+	unsigned int not_full_waiters;
 	// The rear of the queue
 	unsigned int queue_rear;
-	// If true, the queue does not have a maximum capacity
-	int is_boundless;
-	// Number of active callers. Used mainly to synchronize the destroy process.
-	int active_callers_count;
-	// Indicates whether the queue was closed.
+	// Boundless queues store the elements in a linked list of segments instead, so growing never copies the queued elements.
+	// Elements are taken from 'head_segment', at index 'queue_front', and added to 'tail_segment', at index 'queue_rear' (the number
+	// of slots already used in it). The segments after 'tail_segment', until 'last_segment', are empty. When 'queue_front'/'queue_rear'
+	// reach 'segment_capacity', the queue moves on to the next segment, and the emptied head segment is recycled.
+	Blocking_Queue_Segment* tail_segment;
+	Blocking_Queue_Segment* last_segment;
+	// Statistics of the producers. They are written while holding 'mutex' (except for the rejections, which are updated atomically)
+	// and read atomically, without locking. This is also the case of the statistics of the consumers.
+	unsigned long long stats_puts;
+	unsigned long long stats_full_rejections;
+	unsigned long long stats_grow_events;
+	unsigned int stats_max_queue_size;
+	unsigned long long stats_not_full_blocked_ns;
+
+	// --- Written by consumers
+
+	// Fair lock used for get operations
+	BQ_CACHE_ALIGNED Fair_Lock get_lock;
+	// Stores whether weak locks are blocked for the 'get_lock'. Used as an optimization
+	int get_lock_are_weak_locks_blocked;
+	// Number of callers waiting on 'not_empty_cond'. The cond is only signaled if there is a waiter.
+	unsigned int not_empty_waiters;
+	// The front of the queue
+	unsigned int queue_front;
+	// See 'tail_segment'
+	Blocking_Queue_Segment* head_segment;
+	// Number of segments emptied in a row while the occupancy of the queue was low. Used to shrink the free list.
+	unsigned int low_occupancy_streak;
+	// Spare segments detached from the free list by a shrink. They are freed by the consumer after releasing 'mutex'.
+	Blocking_Queue_Segment* segments_to_free;
+	// Statistics of the consumers
+	unsigned long long stats_takes;
+	unsigned long long stats_empty_rejections;
+	unsigned long long stats_shrink_events;
+	unsigned long long stats_not_empty_blocked_ns;
+
+	// --- Written by both sides
+
+	// Main mutex, synchronizes get/add operations.
+	BQ_CACHE_ALIGNED pthread_mutex_t mutex;
+	// Number of elements currently in the queue. Written while holding 'mutex', read atomically (e.g. by the lock-free early-out
+	// of non-blocking calls).
+	unsigned int queue_size;
+	// The capacity of the queue. For boundless queues, the number of slots from the front until the end of 'last_segment'.
+	unsigned int queue_capacity;
+	// Number of wake-ups that were issued/elided (because nobody was waiting). Protected by 'mutex', read atomically.
+	unsigned long long wakeups_signaled;
+	unsigned long long wakeups_elided;
+	// Cond used to wake up the caller blocked waiting for the queue to become non-empty
+	pthread_cond_t not_empty_cond;
+	// Cond used to wake up the caller blocked waiting for the queue to become non-full
+	pthread_cond_t not_full_cond;
+	// Emptied segments kept for reuse, so a queue that oscillates around a segment boundary does not allocate every time
+	Blocking_Queue_Segment* free_segments;
+	unsigned int free_segments_count;
+	// The number of segments allocated (linked to the queue or in the free list). Written while holding 'mutex', read atomically.
+	unsigned int segments_count;
+	// Number of spins before waiting on a cond that succeeded/failed. Updated atomically.
+	unsigned long long wait_spin_successes;
+	unsigned long long wait_spin_failures;
+
+	// --- Lifecycle
+
+	// Number of active callers, plus BQ_CALLERS_CLOSED once 'blocking_queue_close' is waiting for them to leave. Updated
+	// atomically. Used mainly to synchronize the destroy process.
+	BQ_CACHE_ALIGNED unsigned int active_callers_count;
+	// Indicates whether the queue was closed. Written while holding 'mutex', read atomically.
 	int closed;
-	// Mutex to change 'active_callers_count'
+	// Set by the last caller to leave a closed queue. Protected by 'active_callers_mutex'.
+	int active_callers_drained;
+	// Mutex used by 'blocking_queue_close' to wait for the active callers to leave
 	pthread_mutex_t active_callers_mutex;
 	// Cond to help synchronizing the destroy process
 	pthread_cond_t destroy_cond;
@@ -168,13 +380,35 @@ typedef struct {
 // The blocking queue capacity is given by 'capacity'.
 // When capacity > 0, a normal FIFO blocking queue with fixed size is used.
 // When capacity <= 0, the queue will not have a maximum cap. It will, instead, grow without bounds (this is a special case)
+// The elements of such a queue are stored in a linked list of fixed-size segments: growing links a new segment and never copies
+// the queued elements.
 // Note that, in the special case, the queue will serve as a normal boundless thread-safe queue (no blocking will ever occur when adding elements)
 // Returns 0 if success, -1 if error.
 int blocking_queue_init(Blocking_Queue* bq, unsigned int capacity);
+// Init the blocking queue, just like 'blocking_queue_init', but with custom options (see 'Blocking_Queue_Options').
+// If 'options' is NULL, the default options are used.
+// Returns 0 if success, -1 if error.
+int blocking_queue_init_with_options(Blocking_Queue* bq, unsigned int capacity, const Blocking_Queue_Options* options);
+// Init the blocking queue, just like 'blocking_queue_init', but storing fixed-size records of 'element_size' bytes by value,
+// in a contiguous buffer, instead of 'void*' elements.
+// The API is the same, but the elements are copied in and out of the queue:
+// * in _add/_put, 'element' points to the record to be copied into the queue
+// * in _poll/_take, the record is copied to the memory pointed by 'element'
+// * in the '_n' variants, 'elements' points to an array of 'n' records (cast it to 'void**')
+// Returns 0 if success, -1 if error.
+int blocking_queue_init_sized(Blocking_Queue* bq, unsigned int capacity, unsigned int element_size);
+// Init the blocking queue, just like 'blocking_queue_init_with_options', but using 'buffer' (which must have room for 'capacity'
+// elements, i.e. 'capacity * sizeof(void*)' bytes) instead of allocating one. The buffer is not freed by 'blocking_queue_destroy'.
+// 'capacity' must be > 0, and it is used as is ('power_of_two_capacity' is ignored).
+// Combined with 'preallocated_waiters' (see 'Blocking_Queue_Options'), no memory is allocated after the init call as long as
+// there are no more than 'preallocated_waiters' producers and consumers, so no call fails with BQ_ERROR for lack of memory.
+// Returns 0 if success, -1 if error.
+int blocking_queue_init_with_buffer(Blocking_Queue* bq, unsigned int capacity, void* buffer, const Blocking_Queue_Options* options);
 // Adds an element to the blocking queue
 // The element is given by 'element'
 // This function does NOT block the caller.
 // If the queue is full, this function will not add the new element. Instead, it will return BQ_FULL.
+// A call that cannot succeed (the queue is full or closed) fails right away, without taking any lock.
 // FIFO order is guaranteed - blocked callers will be served in FIFO order. There is no starvation.
 // Returns:
 // * 0 if success
@@ -196,6 +430,7 @@ int blocking_queue_put(Blocking_Queue* bq, void* element);
 // The element is stored in '*element'
 // This function does NOT block the caller.
 // If the queue is empty, this function will not poll any element. Instead, it will return BQ_EMPTY.
+// A call that cannot succeed (the queue is empty or closed) fails right away, without taking any lock.
 // FIFO order is guaranteed - blocked callers will be served in FIFO order. There is no starvation.
 // Returns:
 // * 0 if success
@@ -213,6 +448,141 @@ int blocking_queue_poll(Blocking_Queue* bq, void* element);
 // * BQ_ERROR if an error happened
 // * BQ_CLOSED if the blocking queue was closed while the call was blocked
 int blocking_queue_take(Blocking_Queue* bq, void* element);
+// Puts an element to the blocking queue, just like 'blocking_queue_put', but gives up after 'timeout_ns' nanoseconds.
+// The timeout bounds the whole call: waiting for the turn in the FIFO of callers and waiting for space in the queue.
+// A timeout too large to be turned into a deadline (e.g. ULLONG_MAX) means waiting forever, as 'blocking_queue_put'.
+// A caller that times out leaves the FIFO of callers without disturbing the order of the callers behind it.
+// Returns:
+// * 0 if success
+// * BQ_ERROR if an error happened
+// * BQ_TIMEOUT if the element could not be added before the timeout
+// * BQ_CLOSED if the blocking queue was closed while the call was blocked
+int blocking_queue_put_timed(Blocking_Queue* bq, void* element, unsigned long long timeout_ns);
+// Same as 'blocking_queue_put_timed', but with an absolute deadline, in the clock of 'fair_lock_now_ns' (CLOCK_MONOTONIC), so
+// several calls can share the same deadline. If the deadline already passed (0 included), the element is still added if that
+// does not require waiting.
+int blocking_queue_put_until(Blocking_Queue* bq, void* element, unsigned long long deadline_ns);
+// Takes an element from the blocking queue, just like 'blocking_queue_take', but gives up after 'timeout_ns' nanoseconds.
+// The timeout bounds the whole call: waiting for the turn in the FIFO of callers and waiting for an element to take.
+// A caller that times out leaves the FIFO of callers without disturbing the order of the callers behind it.
+// Returns:
+// * 0 if success
+// * BQ_ERROR if an error happened
+// * BQ_TIMEOUT if no element could be taken before the timeout
+// * BQ_CLOSED if the blocking queue was closed while the call was blocked
+int blocking_queue_take_timed(Blocking_Queue* bq, void* element, unsigned long long timeout_ns);
+// Same as 'blocking_queue_take_timed', but with an absolute deadline (see 'blocking_queue_put_until').
+int blocking_queue_take_until(Blocking_Queue* bq, void* element, unsigned long long deadline_ns);
+// Adds up to 'n' elements to the blocking queue
+// The elements are given by the array 'elements'
+// This function does NOT block the caller.
+// As many elements as there is space for are added, in order, in a single lock round-trip. If the queue is full, no element is added
+// and BQ_FULL is returned.
+// The number of elements actually added is stored in '*added' (if 'added' is not NULL).
+// FIFO order is guaranteed - blocked callers will be served in FIFO order. There is no starvation.
+// Returns:
+// * 0 if at least one element was added
+// * BQ_ERROR if an error happened
+// * BQ_FULL if the there is no space in the blocking queue
+// * BQ_CLOSED if the blocking queue was closed while the call was blocked
+int blocking_queue_add_n(Blocking_Queue* bq, void** elements, unsigned int n, unsigned int* added);
+// Puts 'n' elements to the blocking queue
+// The elements are given by the array 'elements'
+// This function may block the caller.
+// The elements are added contiguously, in order: no other producer can add elements in between. If there is not enough space in the
+// queue, the caller adds what fits and is blocked until there is space for the remaining elements.
+// The number of elements actually added is stored in '*added' (if 'added' is not NULL). It is only smaller than 'n' if an error
+// happened or if the queue was closed in the middle of the call.
+// FIFO order is guaranteed - blocked callers will be served in FIFO order. There is no starvation.
+// Returns:
+// * 0 if success
+// * BQ_ERROR if an error happened
+// * BQ_CLOSED if the blocking queue was closed while the call was blocked
+int blocking_queue_put_n(Blocking_Queue* bq, void** elements, unsigned int n, unsigned int* added);
+// Poll up to 'n' elements from the blocking queue
+// The elements are stored in the array 'elements', which must have space for 'n' elements
+// This function does NOT block the caller.
+// As many elements as available (up to 'n') are polled, in order, in a single lock round-trip. If the queue is empty, no element is
+// polled and BQ_EMPTY is returned.
+// The number of elements actually polled is stored in '*polled' (if 'polled' is not NULL).
+// FIFO order is guaranteed - blocked callers will be served in FIFO order. There is no starvation.
+// Returns:
+// * 0 if at least one element was polled
+// * BQ_ERROR if an error happened
+// * BQ_EMPTY if the blocking queue is empty
+// * BQ_CLOSED if the blocking queue was closed while the call was blocked
+int blocking_queue_poll_n(Blocking_Queue* bq, void** elements, unsigned int n, unsigned int* polled);
+// Take 'n' elements from the blocking queue
+// The elements are stored in the array 'elements', which must have space for 'n' elements
+// This function may block the caller.
+// The elements are taken contiguously, in order: no other consumer can take elements in between. If there are not enough elements
+// in the queue, the caller takes what is available and is blocked until the remaining elements are available.
+// The number of elements actually taken is stored in '*taken' (if 'taken' is not NULL). It is only smaller than 'n' if an error
+// happened or if the queue was closed in the middle of the call.
+// FIFO order is guaranteed - blocked callers will be served in FIFO order. There is no starvation.
+// Returns:
+// * 0 if success
+// * BQ_ERROR if an error happened
+// * BQ_CLOSED if the blocking queue was closed while the call was blocked
+int blocking_queue_take_n(Blocking_Queue* bq, void** elements, unsigned int n, unsigned int* taken);
+// Take a batch of up to 'max_n' elements from the blocking queue
+// The elements are stored in the array 'elements', which must have space for 'max_n' elements
+// This function may block the caller.
+// The caller is blocked until at least one element is available. From then on, it keeps waiting for up to 'linger_ns'
+// nanoseconds while fewer than 'max_n' elements are available (and the queue is not full), and then takes all the available
+// elements, up to 'max_n', in a single dequeue. A longer linger gives larger batches at the cost of latency; with a linger of 0,
+// whatever is available is taken as soon as there is one element.
+// The caller keeps its turn in the FIFO of consumers while it lingers, so the batch is contiguous.
+// The number of elements actually taken is stored in '*taken' (if 'taken' is not NULL).
+// FIFO order is guaranteed - blocked callers will be served in FIFO order. There is no starvation.
+// Returns:
+// * 0 if success
+// * BQ_ERROR if an error happened
+// * BQ_CLOSED if the blocking queue was closed while the call was blocked
+int blocking_queue_take_batch(Blocking_Queue* bq, void** elements, unsigned int max_n, unsigned long long linger_ns,
+	unsigned int* taken);
+// Reserves the next slot of the queue, so the element can be written in place, without an intermediate copy.
+// The address of the slot is stored in '*slot'. It points to 'element_size' bytes (a 'void*' for the 'void*' API).
+// This function may block the caller, just like 'blocking_queue_put'. A boundless queue never blocks: if its last segment is full,
+// a new segment is linked first and the slot is in that segment. Segments are never moved, so the slot stays valid until the commit
+// no matter how much the queue grows in the meantime.
+// The element only becomes visible to consumers when 'blocking_queue_commit_put' is called. Until then, the caller keeps its turn
+// in the FIFO of callers adding elements, so other producers (and 'blocking_queue_close') wait for it: commit as soon as possible.
+// Returns:
+// * 0 if success (the caller must call 'blocking_queue_commit_put')
+// * BQ_ERROR if an error happened
+// * BQ_CLOSED if the blocking queue was closed while the call was blocked
+int blocking_queue_reserve_put(Blocking_Queue* bq, void** slot);
+// Publishes the element written to the slot returned by 'blocking_queue_reserve_put'. The slot must not be used afterwards.
+void blocking_queue_commit_put(Blocking_Queue* bq);
+// Acquires the element at the front of the queue, so it can be read in place, without an intermediate copy.
+// The address of the slot is stored in '*slot'. It points to 'element_size' bytes (a 'void*' for the 'void*' API).
+// This function may block the caller, just like 'blocking_queue_take'.
+// In a boundless queue, the segment holding the slot is only recycled (or freed by the shrink policy) once the element is released.
+// The slot is only given back to producers when 'blocking_queue_release_take' is called. Until then, the caller keeps its turn
+// in the FIFO of callers getting elements, so other consumers (and 'blocking_queue_close') wait for it: release as soon as possible.
+// Returns:
+// * 0 if success (the caller must call 'blocking_queue_release_take')
+// * BQ_ERROR if an error happened
+// * BQ_CLOSED if the blocking queue was closed while the call was blocked
+int blocking_queue_acquire_take(Blocking_Queue* bq, void** slot);
+// Removes the element acquired by 'blocking_queue_acquire_take' from the queue. The slot must not be used afterwards.
+void blocking_queue_release_take(Blocking_Queue* bq);
+// Gives the spare segments of a boundless queue (emptied segments kept for reuse) back to the allocator right away, instead of
+// waiting for the shrink policy (see 'blocking_queue_get_footprint'). This includes the spare segment kept when the queue becomes
+// empty. The queue is only locked while the segments are detached, they are freed afterwards. Does nothing for queues with a
+// fixed capacity.
+// Returns the number of bytes given back.
+unsigned long long blocking_queue_trim(Blocking_Queue* bq);
+// Gets the memory currently used by the queue to store elements, in bytes.
+// A fixed-capacity queue always uses 'capacity * element_size' bytes. A boundless queue grows one segment at a time, and gives the
+// spare segments back to the allocator once the occupancy stays below 1/BQ_SHRINK_OCCUPANCY_RATIO of the allocated segments while
+// BQ_SHRINK_DELAY segments are emptied in a row, so a burst does not leave the queue at its peak size while traffic goes on.
+// Besides, whenever a consumer takes the last element, all the spare segments but one are given back: a queue that goes idle
+// right after a burst does not keep its peak footprint either (one that goes idle while still holding elements keeps its
+// segments until 'blocking_queue_trim' is called).
+// This call does not lock the queue.
+unsigned long long blocking_queue_get_footprint(Blocking_Queue* bq);
 // Closes the blocking queue.
 // When a blocking queue is closed, all _add/_put/_poll/_take calls will immediately return BQ_CLOSED if called.
 // If there are active callers blocked in one of these calls, they will also be immediately unblocked and receive BQ_CLOSED.
@@ -231,6 +601,121 @@ void blocking_queue_close(Blocking_Queue* bq);
 // Using it will cause undefined behavior and may crash the program.
 // NOTE: This function can only be called a single time for a given blocking queue. Calling it multiple times will cause undefined behavior.
 void blocking_queue_destroy(Blocking_Queue* bq);
+// Gets how often spinning avoided parking a blocked caller. The counters are read without locking, so they are approximate
+// while there are active callers.
+void blocking_queue_get_spin_stats(Blocking_Queue* bq, Blocking_Queue_Spin_Stats* stats);
+// Gets how many wake-ups were issued and how many were skipped because no counterpart was blocked. The counters are read without
+// locking, so they are approximate while there are active callers.
+void blocking_queue_get_wakeup_stats(Blocking_Queue* bq, Blocking_Queue_Wakeup_Stats* stats);
+// Gets a snapshot of the queue statistics (see 'Blocking_Queue_Stats'). Most counters are only collected if the queue was
+// created with 'collect_stats' (see 'blocking_queue_init_with_options').
+// This call does not lock the queue: each counter is read atomically, but the snapshot as a whole is not. While there are active
+// callers, counters may be slightly out of sync with each other (for example, 'takes' may be momentarily ahead of 'puts').
+void blocking_queue_get_stats(Blocking_Queue* bq, Blocking_Queue_Stats* stats);
+
+// These functions are reserved for internal-use only (they are used by the queues generated with BQ_DEFINE)
+int blocking_queue_init_internal(Blocking_Queue* bq, unsigned int capacity, unsigned int element_size, void* buffer,
+	const Blocking_Queue_Options* options);
+int blocking_queue_add_internal(Blocking_Queue* bq, const void* elements, unsigned int n, int async, unsigned long long deadline_ns,
+	unsigned int* count);
+int blocking_queue_get_internal(Blocking_Queue* bq, void* elements, unsigned int n, int async, unsigned long long deadline_ns,
+	int batch, unsigned long long linger_ns, unsigned int* count);
+// Gets the deadline (see 'fair_lock_now_ns') that is 'timeout_ns' from now. If it does not fit in 64 bits (e.g. a timeout of
+// ULLONG_MAX, meaning to wait forever), returns 0, which means no deadline.
+static inline unsigned long long blocking_queue_deadline_after(unsigned long long timeout_ns) {
+	unsigned long long now_ns = fair_lock_now_ns();
+	return timeout_ns > ~0ull - now_ns ? 0 : now_ns + timeout_ns;
+}
+
+// Generates a blocking queue of 'T' values, called 'name_queue'.
+// Elements are copied by value into the circular buffer (and out of it), so there is no need to allocate each element separately.
+// The generated queue has the same API and semantics of the 'void*' queue, with the 'blocking_queue_' prefix replaced by
+// 'name_queue_', except that elements are passed as 'T' (add/put) and 'T*' (poll/take), and arrays of elements as 'T*'.
+// For example, 'BQ_DEFINE(point, struct point)' generates 'point_queue', 'point_queue_init', 'point_queue_put',
+// 'point_queue_take', etc. 'name_queue_get_stats', 'name_queue_trim' and 'name_queue_get_footprint' are also generated.
+// Use 'power_of_two_capacity' (see 'Blocking_Queue_Options') to have indexes wrapped with a mask.
+// This macro can be used in any source file. The implementation of the blocking queue must be compiled in one of them.
+#define BQ_DEFINE(name, T) \
+	typedef struct { \
+		Blocking_Queue bq; \
+	} name##_queue; \
+	static inline int name##_queue_init(name##_queue* q, unsigned int capacity) { \
+		return blocking_queue_init_internal(&q->bq, capacity, sizeof(T), NULL, NULL); \
+	} \
+	static inline int name##_queue_init_with_options(name##_queue* q, unsigned int capacity, const Blocking_Queue_Options* options) { \
+		return blocking_queue_init_internal(&q->bq, capacity, sizeof(T), NULL, options); \
+	} \
+	static inline int name##_queue_init_with_buffer(name##_queue* q, unsigned int capacity, T* buffer, \
+		const Blocking_Queue_Options* options) { \
+		return buffer ? blocking_queue_init_internal(&q->bq, capacity, sizeof(T), buffer, options) : -1; \
+	} \
+	static inline int name##_queue_add(name##_queue* q, T element) { \
+		return blocking_queue_add_internal(&q->bq, &element, 1, 1, 0, NULL); \
+	} \
+	static inline int name##_queue_put(name##_queue* q, T element) { \
+		return blocking_queue_add_internal(&q->bq, &element, 1, 0, 0, NULL); \
+	} \
+	static inline int name##_queue_poll(name##_queue* q, T* element) { \
+		return blocking_queue_get_internal(&q->bq, element, 1, 1, 0, 0, 0, NULL); \
+	} \
+	static inline int name##_queue_take(name##_queue* q, T* element) { \
+		return blocking_queue_get_internal(&q->bq, element, 1, 0, 0, 0, 0, NULL); \
+	} \
+	static inline int name##_queue_put_timed(name##_queue* q, T element, unsigned long long timeout_ns) { \
+		return blocking_queue_add_internal(&q->bq, &element, 1, 0, blocking_queue_deadline_after(timeout_ns), NULL); \
+	} \
+	static inline int name##_queue_put_until(name##_queue* q, T element, unsigned long long deadline_ns) { \
+		return blocking_queue_add_internal(&q->bq, &element, 1, 0, deadline_ns ? deadline_ns : 1, NULL); \
+	} \
+	static inline int name##_queue_take_timed(name##_queue* q, T* element, unsigned long long timeout_ns) { \
+		return blocking_queue_get_internal(&q->bq, element, 1, 0, blocking_queue_deadline_after(timeout_ns), 0, 0, NULL); \
+	} \
+	static inline int name##_queue_take_until(name##_queue* q, T* element, unsigned long long deadline_ns) { \
+		return blocking_queue_get_internal(&q->bq, element, 1, 0, deadline_ns ? deadline_ns : 1, 0, 0, NULL); \
+	} \
+	static inline int name##_queue_add_n(name##_queue* q, const T* elements, unsigned int n, unsigned int* added) { \
+		return blocking_queue_add_internal(&q->bq, elements, n, 1, 0, added); \
+	} \
+	static inline int name##_queue_put_n(name##_queue* q, const T* elements, unsigned int n, unsigned int* added) { \
+		return blocking_queue_add_internal(&q->bq, elements, n, 0, 0, added); \
+	} \
+	static inline int name##_queue_poll_n(name##_queue* q, T* elements, unsigned int n, unsigned int* polled) { \
+		return blocking_queue_get_internal(&q->bq, elements, n, 1, 0, 0, 0, polled); \
+	} \
+	static inline int name##_queue_take_n(name##_queue* q, T* elements, unsigned int n, unsigned int* taken) { \
+		return blocking_queue_get_internal(&q->bq, elements, n, 0, 0, 0, 0, taken); \
+	} \
+	static inline int name##_queue_take_batch(name##_queue* q, T* elements, unsigned int max_n, unsigned long long linger_ns, \
+		unsigned int* taken) { \
+		return blocking_queue_get_internal(&q->bq, elements, max_n, 0, 0, 1, linger_ns, taken); \
+	} \
+	static inline int name##_queue_reserve_put(name##_queue* q, T** slot) { \
+		return blocking_queue_reserve_put(&q->bq, (void**)slot); \
+	} \
+	static inline void name##_queue_commit_put(name##_queue* q) { \
+		blocking_queue_commit_put(&q->bq); \
+	} \
+	static inline int name##_queue_acquire_take(name##_queue* q, T** slot) { \
+		return blocking_queue_acquire_take(&q->bq, (void**)slot); \
+	} \
+	static inline void name##_queue_release_take(name##_queue* q) { \
+		blocking_queue_release_take(&q->bq); \
+	} \
+	static inline void name##_queue_close(name##_queue* q) { \
+		blocking_queue_close(&q->bq); \
+	} \
+	static inline void name##_queue_destroy(name##_queue* q) { \
+		blocking_queue_destroy(&q->bq); \
+	} \
+	static inline void name##_queue_get_stats(name##_queue* q, Blocking_Queue_Stats* stats) { \
+		blocking_queue_get_stats(&q->bq, stats); \
+	} \
+	static inline unsigned long long name##_queue_trim(name##_queue* q) { \
+		return blocking_queue_trim(&q->bq); \
+	} \
+	static inline unsigned long long name##_queue_get_footprint(name##_queue* q) { \
+		return blocking_queue_get_footprint(&q->bq); \
+	}
 
 #ifdef C_FEK_BLOCKING_QUEUE_IMPLEMENTATION
 #if !defined(C_FEK_BLOCKING_QUEUE_NO_CRT)
@@ -238,8 +723,91 @@ void blocking_queue_destroy(Blocking_Queue* bq);
 #include <memory.h>
 #endif
 
+// Flag added to 'active_callers_count' by 'blocking_queue_close' when it starts waiting for the active callers to leave
+#define BQ_CALLERS_CLOSED 0x80000000u
+
+#if defined(C_FEK_BLOCKING_QUEUE_WAIT_HOOK)
+#define BQ_WAIT_BEGIN(start) unsigned long long start = fair_lock_now_ns()
+#define BQ_WAIT_END(bq, start, kind) C_FEK_BLOCKING_QUEUE_WAIT_HOOK(bq, kind, fair_lock_now_ns() - start)
+#else
+#define BQ_WAIT_BEGIN(start)
+#define BQ_WAIT_END(bq, start, kind)
+#endif
+
+#if defined(C_FEK_BLOCKING_QUEUE_USDT)
+#include <sys/sdt.h>
+#define BQ_PROBE1(name, a) DTRACE_PROBE1(c_fek_blocking_queue, name, a)
+#define BQ_PROBE2(name, a, b) DTRACE_PROBE2(c_fek_blocking_queue, name, a, b)
+#define BQ_PROBE4(name, a, b, c, d) DTRACE_PROBE4(c_fek_blocking_queue, name, a, b, c, d)
+#else
+#define BQ_PROBE1(name, a)
+#define BQ_PROBE2(name, a, b)
+#define BQ_PROBE4(name, a, b, c, d)
+#endif
+
+static void* queue_alloc(Blocking_Queue* bq, size_t size) {
+	if (bq->allocator.alloc) {
+		return bq->allocator.alloc(bq->allocator.ctx, size);
+	}
+	return malloc(size);
+}
+
+static void queue_free(Blocking_Queue* bq, void* block, size_t size) {
+	if (bq->allocator.free) {
+		bq->allocator.free(bq->allocator.ctx, block, size);
+	} else {
+		free(block);
+	}
+}
+
+// Returns the number of bytes of a segment (including its header)
+static size_t segment_footprint(Blocking_Queue* bq) {
+	return sizeof(Blocking_Queue_Segment) + (size_t)bq->segment_capacity * bq->element_size;
+}
+
+static void free_segment_list(Blocking_Queue* bq, Blocking_Queue_Segment* segment) {
+	while (segment) {
+		Blocking_Queue_Segment* next = segment->next;
+		queue_free(bq, segment, segment_footprint(bq));
+		segment = next;
+	}
+}
+
 int blocking_queue_init(Blocking_Queue* bq, unsigned int capacity)
 {
+	return blocking_queue_init_with_options(bq, capacity, NULL);
+}
+
+int blocking_queue_init_with_options(Blocking_Queue* bq, unsigned int capacity, const Blocking_Queue_Options* options)
+{
+	return blocking_queue_init_internal(bq, capacity, sizeof(void*), NULL, options);
+}
+
+int blocking_queue_init_with_buffer(Blocking_Queue* bq, unsigned int capacity, void* buffer, const Blocking_Queue_Options* options)
+{
+	if (buffer == NULL) {
+		return -1;
+	}
+	return blocking_queue_init_internal(bq, capacity, sizeof(void*), buffer, options);
+}
+
+int blocking_queue_init_sized(Blocking_Queue* bq, unsigned int capacity, unsigned int element_size)
+{
+	if (blocking_queue_init_internal(bq, capacity, element_size, NULL, NULL)) {
+		return -1;
+	}
+	bq->is_sized = 1;
+	return 0;
+}
+
+// Init the blocking queue. If 'buffer' is not NULL, it is used as the circular buffer, as is (the queue must have a fixed capacity).
+int blocking_queue_init_internal(Blocking_Queue* bq, unsigned int capacity, unsigned int element_size, void* buffer,
+	const Blocking_Queue_Options* options)
+{
+	if (element_size == 0 || (buffer && capacity == 0)) {
+		return -1;
+	}
+
 	if (pthread_mutex_init(&bq->mutex, NULL)) {
 		return -1;
 	}
@@ -255,10 +823,18 @@ int blocking_queue_init(Blocking_Queue* bq, unsigned int capacity)
 		return -1;
 	}
 
-	if (pthread_cond_init(&bq->cond, NULL)) {
+	if (fair_lock_cond_init(&bq->not_empty_cond)) {
+		pthread_mutex_destroy(&bq->mutex);
+		pthread_mutex_destroy(&bq->active_callers_mutex);
+		pthread_mutex_destroy(&bq->close_mutex);
+		return -1;
+	}
+
+	if (fair_lock_cond_init(&bq->not_full_cond)) {
 		pthread_mutex_destroy(&bq->mutex);
 		pthread_mutex_destroy(&bq->active_callers_mutex);
 		pthread_mutex_destroy(&bq->close_mutex);
+		pthread_cond_destroy(&bq->not_empty_cond);
 		return -1;
 	}
 
@@ -266,50 +842,113 @@ int blocking_queue_init(Blocking_Queue* bq, unsigned int capacity)
 		pthread_mutex_destroy(&bq->mutex);
 		pthread_mutex_destroy(&bq->active_callers_mutex);
 		pthread_mutex_destroy(&bq->close_mutex);
-		pthread_cond_destroy(&bq->cond);
+		pthread_cond_destroy(&bq->not_empty_cond);
+		pthread_cond_destroy(&bq->not_full_cond);
 		return -1;
 	}
 
-	if (fair_lock_init(&bq->get_lock)) {
+	const Fair_Lock_Allocator* allocator = options ? &options->allocator : NULL;
+	unsigned int preallocated_waiters = options ? options->preallocated_waiters : 0;
+	if (fair_lock_init_with_capacity(&bq->get_lock, preallocated_waiters, allocator)) {
 		pthread_mutex_destroy(&bq->mutex);
 		pthread_mutex_destroy(&bq->active_callers_mutex);
 		pthread_mutex_destroy(&bq->close_mutex);
-		pthread_cond_destroy(&bq->cond);
+		pthread_cond_destroy(&bq->not_empty_cond);
+		pthread_cond_destroy(&bq->not_full_cond);
 		pthread_cond_destroy(&bq->destroy_cond);
 		return -1;
 	}
 
-	if (fair_lock_init(&bq->add_lock)) {
+	if (fair_lock_init_with_capacity(&bq->add_lock, preallocated_waiters, allocator)) {
 		pthread_mutex_destroy(&bq->mutex);
 		pthread_mutex_destroy(&bq->active_callers_mutex);
 		pthread_mutex_destroy(&bq->close_mutex);
-		pthread_cond_destroy(&bq->cond);
+		pthread_cond_destroy(&bq->not_empty_cond);
+		pthread_cond_destroy(&bq->not_full_cond);
 		pthread_cond_destroy(&bq->destroy_cond);
 		fair_lock_destroy(&bq->get_lock);
 		return -1;
 	}
 
+	bq->allocator = bq->get_lock.allocator;
+	bq->head_segment = NULL;
+	bq->tail_segment = NULL;
+	bq->last_segment = NULL;
+	bq->free_segments = NULL;
+	bq->free_segments_count = 0;
+	bq->low_occupancy_streak = 0;
+	bq->segments_to_free = NULL;
+	bq->segment_capacity = 0;
+	bq->segments_count = 0;
 	if (capacity <= 0) {
-		bq->queue_capacity = 1;
+		bq->segment_capacity = options && options->segment_capacity ? options->segment_capacity : BQ_DEFAULT_SEGMENT_CAPACITY;
+		bq->queue_capacity = bq->segment_capacity;
 		bq->is_boundless = 1;
 	} else {
 		bq->queue_capacity = capacity;
 		bq->is_boundless = 0;
+		if (options && options->power_of_two_capacity && !buffer) {
+			bq->queue_capacity = 1;
+			while (bq->queue_capacity < capacity) {
+				bq->queue_capacity <<= 1;
+			}
+		}
 	}
+	bq->queue_mask = !bq->is_boundless && (bq->queue_capacity & (bq->queue_capacity - 1)) == 0 ? bq->queue_capacity - 1 : 0;
+	bq->element_size = element_size;
+	bq->is_sized = 0;
+	bq->is_buffer_borrowed = buffer != NULL;
 	bq->queue_size = 0;
 	bq->queue_front = 0;
-	bq->queue_rear = bq->queue_capacity - 1;
+	bq->queue_rear = bq->is_boundless ? 0 : bq->queue_capacity - 1;
 	bq->closed = 0;
 	bq->active_callers_count = 0;
+	bq->active_callers_drained = 0;
 	bq->get_lock_are_weak_locks_blocked = 0;
 	bq->add_lock_are_weak_locks_blocked = 0;
-	bq->queue = (void**)malloc(bq->queue_capacity * sizeof(void*));
-	if (bq->queue == NULL)
+	bq->spin_policy.max_iterations = 0;
+	bq->spin_policy.max_ns = 0;
+	bq->wait_spin_successes = 0;
+	bq->wait_spin_failures = 0;
+	bq->not_empty_waiters = 0;
+	bq->not_full_waiters = 0;
+	bq->wakeups_signaled = 0;
+	bq->wakeups_elided = 0;
+	bq->collect_stats = 0;
+	bq->stats_puts = 0;
+	bq->stats_takes = 0;
+	bq->stats_full_rejections = 0;
+	bq->stats_empty_rejections = 0;
+	bq->stats_grow_events = 0;
+	bq->stats_shrink_events = 0;
+	bq->stats_max_queue_size = 0;
+	bq->stats_not_full_blocked_ns = 0;
+	bq->stats_not_empty_blocked_ns = 0;
+	if (options) {
+		bq->collect_stats = options->collect_stats;
+		bq->spin_policy = options->spin_policy;
+		fair_lock_set_spin_policy(&bq->get_lock, &options->spin_policy);
+		fair_lock_set_spin_policy(&bq->add_lock, &options->spin_policy);
+	}
+	if (bq->is_boundless) {
+		bq->queue = NULL;
+		bq->head_segment = (Blocking_Queue_Segment*)queue_alloc(bq, segment_footprint(bq));
+		if (bq->head_segment) {
+			bq->head_segment->next = NULL;
+			bq->tail_segment = bq->head_segment;
+			bq->last_segment = bq->head_segment;
+			bq->segments_count = 1;
+		}
+	} else {
+		bq->queue = buffer ? (unsigned char*)buffer : (unsigned char*)queue_alloc(bq, (size_t)bq->queue_capacity * element_size);
+	}
+	if (bq->queue == NULL && bq->head_segment == NULL)
 	{
 		pthread_mutex_destroy(&bq->mutex);
 		pthread_mutex_destroy(&bq->active_callers_mutex);
 		pthread_mutex_destroy(&bq->close_mutex);
-		pthread_cond_destroy(&bq->cond);
+		pthread_cond_destroy(&bq->not_empty_cond);
+		pthread_cond_destroy(&bq->not_full_cond);
 		pthread_cond_destroy(&bq->destroy_cond);
 		fair_lock_destroy(&bq->get_lock);
 		fair_lock_destroy(&bq->add_lock);
@@ -327,166 +966,669 @@ void blocking_queue_close(Blocking_Queue* bq) {
 		pthread_mutex_unlock(&bq->close_mutex);
 		return;
 	}
-	bq->closed = 1;
+	__atomic_store_n(&bq->closed, 1, __ATOMIC_RELAXED);
+	// Nobody waits for anybody else: callers waiting for space/elements see 'closed' and leave, and callers waiting for their
+	// turn in the fair locks are abandoned, instead of getting the lock one after the other just to find out the queue is closed
+	pthread_cond_broadcast(&bq->not_empty_cond);
+	pthread_cond_broadcast(&bq->not_full_cond);
 	pthread_mutex_unlock(&bq->mutex);
-
-	pthread_mutex_lock(&bq->active_callers_mutex);
-	while (bq->active_callers_count) {
-		pthread_cond_signal(&bq->cond);
-		pthread_cond_wait(&bq->destroy_cond, &bq->active_callers_mutex);
+	fair_lock_close(&bq->add_lock);
+	fair_lock_close(&bq->get_lock);
+	BQ_PROBE1(close, bq);
+
+	// If callers are still active, the last one to leave sets 'active_callers_drained'
+	if (__atomic_or_fetch(&bq->active_callers_count, BQ_CALLERS_CLOSED, __ATOMIC_SEQ_CST) != BQ_CALLERS_CLOSED) {
+		pthread_mutex_lock(&bq->active_callers_mutex);
+		while (!bq->active_callers_drained) {
+			pthread_cond_wait(&bq->destroy_cond, &bq->active_callers_mutex);
+		}
+		pthread_mutex_unlock(&bq->active_callers_mutex);
 	}
-	pthread_mutex_unlock(&bq->active_callers_mutex);
 	pthread_mutex_unlock(&bq->close_mutex);
 }
 
 void blocking_queue_destroy(Blocking_Queue* bq) {
+	BQ_PROBE1(destroy, bq);
 	blocking_queue_close(bq);
-	free(bq->queue);
+	if (bq->queue && !bq->is_buffer_borrowed) {
+		queue_free(bq, bq->queue, (size_t)bq->queue_capacity * bq->element_size);
+	}
+	free_segment_list(bq, bq->head_segment);
+	free_segment_list(bq, bq->free_segments);
+	free_segment_list(bq, bq->segments_to_free);
 	fair_lock_destroy(&bq->get_lock);
 	fair_lock_destroy(&bq->add_lock);
 	pthread_mutex_destroy(&bq->mutex);
+	pthread_mutex_destroy(&bq->active_callers_mutex);
 	pthread_mutex_destroy(&bq->close_mutex);
+	pthread_cond_destroy(&bq->not_empty_cond);
+	pthread_cond_destroy(&bq->not_full_cond);
+	pthread_cond_destroy(&bq->destroy_cond);
+}
+
+// Returns 'index' wrapped around the capacity of the queue. When the capacity is a power of two, a mask is used instead of '%'.
+static inline unsigned int wrap_index(Blocking_Queue* bq, unsigned int index) {
+	return bq->queue_mask ? index & bq->queue_mask : index % bq->queue_capacity;
+}
+
+// Returns the address of the slot 'index' of the queue
+static inline unsigned char* slot_address(Blocking_Queue* bq, unsigned int index) {
+	return bq->queue + (size_t)index * bq->element_size;
+}
+
+static inline void copy_element(Blocking_Queue* bq, void* dest, const void* src) {
+	if (bq->element_size == sizeof(void*)) {
+		// Constant size, so this is a single move for the (most common) 'void*' queues
+		memcpy(dest, src, sizeof(void*));
+	} else {
+		memcpy(dest, src, bq->element_size);
+	}
+}
+
+// Returns the address of the slot 'index' of 'segment'
+static inline unsigned char* segment_slot_address(Blocking_Queue* bq, Blocking_Queue_Segment* segment, unsigned int index) {
+	return (unsigned char*)segment->elements + (size_t)index * bq->element_size;
+}
+
+// Returns the address of the slot where the next element will be added. There must be space for it.
+static unsigned char* rear_slot_address(Blocking_Queue* bq) {
+	if (!bq->is_boundless) {
+		return slot_address(bq, wrap_index(bq, bq->queue_rear + 1));
+	}
+	if (bq->queue_rear == bq->segment_capacity) {
+		return segment_slot_address(bq, bq->tail_segment->next, 0);
+	}
+	return segment_slot_address(bq, bq->tail_segment, bq->queue_rear);
+}
+
+// Returns the address of the element at the front of the queue. The queue must not be empty.
+static unsigned char* front_slot_address(Blocking_Queue* bq) {
+	if (!bq->is_boundless) {
+		return slot_address(bq, bq->queue_front);
+	}
+	if (bq->queue_front == bq->segment_capacity) {
+		return segment_slot_address(bq, bq->head_segment->next, 0);
+	}
+	return segment_slot_address(bq, bq->head_segment, bq->queue_front);
+}
+
+// Detaches the free list from the queue, except for its first segment if 'keep_one' is true, and returns the detached segments
+// (which are no longer counted in 'segments_count'). This is O(1): freeing them is up to the caller, after releasing the mutex.
+// Must be called with 'bq->mutex' held.
+static Blocking_Queue_Segment* detach_free_segments(Blocking_Queue* bq, int keep_one) {
+	unsigned int keep = keep_one ? 1 : 0;
+	if (bq->free_segments_count <= keep) {
+		return NULL;
+	}
+
+	Blocking_Queue_Segment* detached;
+	if (keep_one) {
+		detached = bq->free_segments->next;
+		bq->free_segments->next = NULL;
+	} else {
+		detached = bq->free_segments;
+		bq->free_segments = NULL;
+	}
+	__atomic_store_n(&bq->segments_count, bq->segments_count - (bq->free_segments_count - keep), __ATOMIC_RELAXED);
+	bq->free_segments_count = keep;
+	if (bq->collect_stats) {
+		__atomic_store_n(&bq->stats_shrink_events, bq->stats_shrink_events + 1, __ATOMIC_RELAXED);
+	}
+	return detached;
+}
+
+// Gives back a segment that is no longer linked to the queue: it is kept in the free list for reuse.
+// If the occupancy of the queue stays low while BQ_SHRINK_DELAY segments are released, the free list is detached (but for one
+// spare segment), to be freed by the consumer after releasing the mutex. Growing is immediate but shrinking needs a sustained low
+// occupancy, so a queue oscillating around its usual size does not keep allocating and freeing segments.
+static void release_segment(Blocking_Queue* bq, Blocking_Queue_Segment* segment) {
+	segment->next = bq->free_segments;
+	bq->free_segments = segment;
+	++bq->free_segments_count;
+
+	unsigned long long allocated = (unsigned long long)bq->segments_count * bq->segment_capacity;
+	if ((unsigned long long)bq->queue_size * BQ_SHRINK_OCCUPANCY_RATIO >= allocated) {
+		bq->low_occupancy_streak = 0;
+		return;
+	}
+	if (++bq->low_occupancy_streak < BQ_SHRINK_DELAY || bq->segments_to_free) {
+		// If the segments detached before were not freed yet (a batch of elements is being taken), shrinks on the next release
+		return;
+	}
+	bq->low_occupancy_streak = 0;
+	bq->segments_to_free = detach_free_segments(bq, 1);
+}
+
+// Called after elements were taken from a boundless queue. If it is now empty, the free list is detached (but for one spare
+// segment) right away: the queue may stay idle, and the shrink policy of 'release_segment' only runs while segments are emptied.
+// Keeping a spare segment means a queue going back and forth between empty and a few elements does not allocate every time.
+static void release_spare_segments_if_empty(Blocking_Queue* bq) {
+	if (bq->queue_size || bq->free_segments_count <= 1 || bq->segments_to_free) {
+		return;
+	}
+	bq->low_occupancy_streak = 0;
+	bq->segments_to_free = detach_free_segments(bq, 1);
+}
+
+// Returns the segments detached by the shrink policy, so they can be freed after releasing the mutex.
+// Must be called with 'bq->mutex' held.
+static Blocking_Queue_Segment* take_segments_to_free(Blocking_Queue* bq) {
+	Blocking_Queue_Segment* segments = bq->segments_to_free;
+	bq->segments_to_free = NULL;
+	return segments;
+}
+
+// Makes the slot returned by 'rear_slot_address' part of the queue
+static void advance_rear(Blocking_Queue* bq) {
+	if (!bq->is_boundless) {
+		bq->queue_rear = wrap_index(bq, bq->queue_rear + 1);
+	} else {
+		if (bq->queue_rear == bq->segment_capacity) {
+			bq->tail_segment = bq->tail_segment->next;
+			bq->queue_rear = 0;
+		}
+		++bq->queue_rear;
+	}
+	__atomic_store_n(&bq->queue_size, bq->queue_size + 1, __ATOMIC_RELAXED);
 }
 
-static void enqueue(Blocking_Queue *bq, void *element) {
+// Removes the element returned by 'front_slot_address' from the queue
+static void advance_front(Blocking_Queue* bq) {
+	if (!bq->is_boundless) {
+		bq->queue_front = wrap_index(bq, bq->queue_front + 1);
+	} else {
+		if (bq->queue_front == bq->segment_capacity) {
+			Blocking_Queue_Segment* emptied = bq->head_segment;
+			bq->head_segment = emptied->next;
+			bq->queue_front = 0;
+			release_segment(bq, emptied);
+		}
+		++bq->queue_front;
+		// The slot can no longer be used, until the segment is recycled
+		--bq->queue_capacity;
+	}
+	__atomic_store_n(&bq->queue_size, bq->queue_size - 1, __ATOMIC_RELAXED);
+	if (bq->is_boundless) {
+		release_spare_segments_if_empty(bq);
+	}
+}
+
+static void enqueue(Blocking_Queue *bq, const void *element) {
 	//assert(bq->queue_size < bq->queue_capacity);
-	bq->queue_rear = (bq->queue_rear + 1) % bq->queue_capacity;
-	bq->queue[bq->queue_rear] = element;
-	bq->queue_size = bq->queue_size + 1;
+	copy_element(bq, rear_slot_address(bq), element);
+	advance_rear(bq);
 }
 
-static void *dequeue(Blocking_Queue *bq) {
+static void dequeue(Blocking_Queue *bq, void *element) {
   //assert(bq->queue_size > 0);
 
-  void* element = bq->queue[bq->queue_front];
-  bq->queue_front = (bq->queue_front + 1) % bq->queue_capacity;
-  bq->queue_size = bq->queue_size - 1;
-  return element;
+  copy_element(bq, element, front_slot_address(bq));
+  advance_front(bq);
+}
+
+// Wakes up the caller waiting on 'cond', if any ('waiters' is the number of callers waiting on it).
+// Must be called with 'bq->mutex' held.
+static void signal_waiter(Blocking_Queue* bq, pthread_cond_t* cond, unsigned int waiters) {
+	if (waiters) {
+		pthread_cond_signal(cond);
+		__atomic_store_n(&bq->wakeups_signaled, bq->wakeups_signaled + 1, __ATOMIC_RELAXED);
+	} else {
+		__atomic_store_n(&bq->wakeups_elided, bq->wakeups_elided + 1, __ATOMIC_RELAXED);
+	}
 }
 
 static void increase_active_callers_count(Blocking_Queue* bq) {
-	pthread_mutex_lock(&bq->active_callers_mutex);
-	++bq->active_callers_count;
-	pthread_mutex_unlock(&bq->active_callers_mutex);
+	__atomic_add_fetch(&bq->active_callers_count, 1, __ATOMIC_SEQ_CST);
 }
 
 static void decrease_active_callers_count(Blocking_Queue* bq) {
-	pthread_mutex_lock(&bq->active_callers_mutex);
-	--bq->active_callers_count;
-	pthread_cond_signal(&bq->destroy_cond);
-	pthread_mutex_unlock(&bq->active_callers_mutex);
+	// Only the last caller to leave after 'blocking_queue_close' started waiting sees exactly BQ_CALLERS_CLOSED
+	if (__atomic_sub_fetch(&bq->active_callers_count, 1, __ATOMIC_SEQ_CST) == BQ_CALLERS_CLOSED) {
+		pthread_mutex_lock(&bq->active_callers_mutex);
+		bq->active_callers_drained = 1;
+		pthread_cond_signal(&bq->destroy_cond);
+		pthread_mutex_unlock(&bq->active_callers_mutex);
+	}
 }
 
+// Links a new segment at the end of a boundless queue (taken from the free list, if possible). Never copies the queued elements.
+// Returns 0 if success, 1 otherwise.
 static int grow_queue(Blocking_Queue* bq) {
-	unsigned int new_capacity = bq->queue_capacity * 2u;
-	void** new_queue = (void**)malloc(new_capacity * sizeof(void*));
-	if (new_queue == NULL) {
-		return 1;
+	Blocking_Queue_Segment* segment = bq->free_segments;
+	if (segment) {
+		bq->free_segments = segment->next;
+		--bq->free_segments_count;
+	} else {
+		segment = (Blocking_Queue_Segment*)queue_alloc(bq, segment_footprint(bq));
+		if (segment == NULL) {
+			return 1;
+		}
+		__atomic_store_n(&bq->segments_count, bq->segments_count + 1, __ATOMIC_RELAXED);
+	}
+
+	segment->next = NULL;
+	bq->last_segment->next = segment;
+	bq->last_segment = segment;
+	bq->queue_capacity += bq->segment_capacity;
+	BQ_PROBE2(grow, bq, bq->segments_count);
+	return 0;
+}
+
+// Copies 'n' elements into the segments of a boundless queue, moving on to the next segment whenever one is full
+static void enqueue_n_segments(Blocking_Queue* bq, const unsigned char* elements, unsigned int n) {
+	unsigned int remaining = n;
+	while (remaining > 0) {
+		if (bq->queue_rear == bq->segment_capacity) {
+			bq->tail_segment = bq->tail_segment->next;
+			bq->queue_rear = 0;
+		}
+		unsigned int chunk = bq->segment_capacity - bq->queue_rear;
+		if (chunk > remaining) {
+			chunk = remaining;
+		}
+		size_t chunk_size = (size_t)chunk * bq->element_size;
+		memcpy(segment_slot_address(bq, bq->tail_segment, bq->queue_rear), elements, chunk_size);
+		bq->queue_rear += chunk;
+		elements += chunk_size;
+		remaining -= chunk;
 	}
+	__atomic_store_n(&bq->queue_size, bq->queue_size + n, __ATOMIC_RELAXED);
+}
 
-	if (bq->queue_rear >= bq->queue_front) {
-		memcpy(new_queue, bq->queue + bq->queue_front, bq->queue_size * sizeof(void*));
-	} else if (bq->queue_front > bq->queue_rear) {
-		memcpy(new_queue, bq->queue + bq->queue_front, (bq->queue_capacity - bq->queue_front) * sizeof(void*));
-		memcpy(new_queue + (bq->queue_capacity - bq->queue_front), bq->queue, (bq->queue_rear + 1) * sizeof(void*));
+// Copies 'n' elements out of the segments of a boundless queue, recycling the segments that are emptied
+static void dequeue_n_segments(Blocking_Queue* bq, unsigned char* elements, unsigned int n) {
+	unsigned int remaining = n;
+	while (remaining > 0) {
+		if (bq->queue_front == bq->segment_capacity) {
+			Blocking_Queue_Segment* emptied = bq->head_segment;
+			bq->head_segment = emptied->next;
+			bq->queue_front = 0;
+			release_segment(bq, emptied);
+		}
+		unsigned int chunk = bq->segment_capacity - bq->queue_front;
+		if (chunk > remaining) {
+			chunk = remaining;
+		}
+		size_t chunk_size = (size_t)chunk * bq->element_size;
+		memcpy(elements, segment_slot_address(bq, bq->head_segment, bq->queue_front), chunk_size);
+		bq->queue_front += chunk;
+		elements += chunk_size;
+		remaining -= chunk;
 	}
+	bq->queue_capacity -= n;
+	__atomic_store_n(&bq->queue_size, bq->queue_size - n, __ATOMIC_RELAXED);
+	release_spare_segments_if_empty(bq);
+}
 
-	free(bq->queue);
-	bq->queue = new_queue;
-	bq->queue_capacity = new_capacity;
-	bq->queue_front = 0;
-	bq->queue_rear = bq->queue_size - 1;
+static void enqueue_n(Blocking_Queue* bq, const unsigned char* elements, unsigned int n) {
+	//assert(bq->queue_size + n <= bq->queue_capacity);
+	if (n == 1) {
+		enqueue(bq, elements);
+		return;
+	}
+	if (bq->is_boundless) {
+		enqueue_n_segments(bq, elements, n);
+		return;
+	}
+
+	// The elements are copied in at most two chunks: until the end of the buffer, and then from its beginning
+	unsigned int start = wrap_index(bq, bq->queue_rear + 1);
+	unsigned int first_chunk = bq->queue_capacity - start;
+	if (first_chunk > n) {
+		first_chunk = n;
+	}
+	size_t first_chunk_size = (size_t)first_chunk * bq->element_size;
+	memcpy(slot_address(bq, start), elements, first_chunk_size);
+	memcpy(bq->queue, elements + first_chunk_size, (size_t)(n - first_chunk) * bq->element_size);
+	bq->queue_rear = wrap_index(bq, bq->queue_rear + n);
+	__atomic_store_n(&bq->queue_size, bq->queue_size + n, __ATOMIC_RELAXED);
+}
+
+static void dequeue_n(Blocking_Queue* bq, unsigned char* elements, unsigned int n) {
+	//assert(bq->queue_size >= n);
+	if (n == 1) {
+		dequeue(bq, elements);
+		return;
+	}
+	if (bq->is_boundless) {
+		dequeue_n_segments(bq, elements, n);
+		return;
+	}
+
+	unsigned int first_chunk = bq->queue_capacity - bq->queue_front;
+	if (first_chunk > n) {
+		first_chunk = n;
+	}
+	size_t first_chunk_size = (size_t)first_chunk * bq->element_size;
+	memcpy(elements, slot_address(bq, bq->queue_front), first_chunk_size);
+	memcpy(elements + first_chunk_size, bq->queue, (size_t)(n - first_chunk) * bq->element_size);
+	bq->queue_front = wrap_index(bq, bq->queue_front + n);
+	__atomic_store_n(&bq->queue_size, bq->queue_size - n, __ATOMIC_RELAXED);
+}
+
+// Spins, following the spin policy, while the size of the queue stays the same (full for producers; empty, or not yet big enough
+// for a batch, for consumers).
+// Must be called with 'bq->mutex' held. The mutex is released while spinning and is held again when the function returns.
+// Returns true if the queue changed (or was closed) while spinning, so the caller should re-check it instead of waiting on a cond.
+static int spin_before_wait(Blocking_Queue* bq) {
+	if (bq->spin_policy.max_iterations == 0) {
+		return 0;
+	}
+
+	unsigned int blocked_size = bq->queue_size;
+	int changed = 0;
+	Fair_Lock_Spinner spinner;
+	pthread_mutex_unlock(&bq->mutex);
+	fair_lock_spinner_init(&spinner, &bq->spin_policy);
+	while (fair_lock_spinner_spin(&spinner)) {
+		if (__atomic_load_n(&bq->queue_size, __ATOMIC_RELAXED) != blocked_size || __atomic_load_n(&bq->closed, __ATOMIC_RELAXED)) {
+			changed = 1;
+			break;
+		}
+	}
+	__atomic_add_fetch(changed ? &bq->wait_spin_successes : &bq->wait_spin_failures, 1, __ATOMIC_RELAXED);
+	pthread_mutex_lock(&bq->mutex);
+	// The counterpart may have skipped the wake-up after our last check, since nobody was waiting yet
+	return changed || bq->queue_size != blocked_size || bq->closed;
+}
+
+// Grows a boundless queue until there is space for 'n' more elements, or growing fails.
+// Must be called with 'bq->mutex' and the 'add_lock' held.
+static void grow_to_fit(Blocking_Queue* bq, unsigned int n) {
+	while (bq->queue_capacity - bq->queue_size < n) {
+		if (grow_queue(bq)) {
+			break;
+		}
+		if (bq->collect_stats) {
+			__atomic_store_n(&bq->stats_grow_events, bq->stats_grow_events + 1, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+// Bookkeeping after 'n' elements were added to the queue: wakes up a blocked consumer, updates the statistics, etc.
+// 'first_element' is only used for tracing. Must be called with 'bq->mutex' held.
+static void elements_added(Blocking_Queue* bq, const void* first_element, unsigned int n) {
+	if (bq->get_lock_are_weak_locks_blocked) {
+		fair_lock_allow_weak_locks(&bq->get_lock);
+		bq->get_lock_are_weak_locks_blocked = 0;
+	}
+	signal_waiter(bq, &bq->not_empty_cond, bq->not_empty_waiters);
+	BQ_PROBE4(enqueue, bq, first_element, n, bq->queue_size);
+	(void)first_element;
+	if (bq->collect_stats) {
+		__atomic_store_n(&bq->stats_puts, bq->stats_puts + n, __ATOMIC_RELAXED);
+		if (bq->queue_size > bq->stats_max_queue_size) {
+			__atomic_store_n(&bq->stats_max_queue_size, bq->queue_size, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+// Bookkeeping after 'n' elements were taken from the queue: wakes up a blocked producer, updates the statistics, etc.
+// 'first_element' is only used for tracing. Must be called with 'bq->mutex' held.
+static void elements_taken(Blocking_Queue* bq, const void* first_element, unsigned int n) {
+	if (bq->add_lock_are_weak_locks_blocked) {
+		fair_lock_allow_weak_locks(&bq->add_lock);
+		bq->add_lock_are_weak_locks_blocked = 0;
+	}
+	signal_waiter(bq, &bq->not_full_cond, bq->not_full_waiters);
+	BQ_PROBE4(dequeue, bq, first_element, n, bq->queue_size);
+	(void)first_element;
+	if (bq->collect_stats) {
+		__atomic_store_n(&bq->stats_takes, bq->stats_takes + n, __ATOMIC_RELAXED);
+	}
+}
+
+// Blocks the caller (which holds the 'add_lock') until the queue may have space for more elements, or until 'deadline_ns' (see
+// 'fair_lock_now_ns', 0 means no deadline).
+// Must be called with 'bq->mutex' held. Callers must re-check the queue when this function returns.
+// Returns BQ_TIMEOUT, without waiting, if the deadline already passed. Returns 0 otherwise.
+static int wait_not_full(Blocking_Queue* bq, unsigned long long deadline_ns) {
+	if (deadline_ns && fair_lock_now_ns() >= deadline_ns) {
+		return BQ_TIMEOUT;
+	}
+	if (!bq->add_lock_are_weak_locks_blocked) {
+		fair_lock_block_weak_locks(&bq->add_lock);
+		bq->add_lock_are_weak_locks_blocked = 1;
+	}
+	BQ_WAIT_BEGIN(wait_start);
+	BQ_PROBE2(block, bq, 1);
+	if (!spin_before_wait(bq)) {
+		unsigned long long blocked_start = bq->collect_stats ? fair_lock_now_ns() : 0;
+		++bq->not_full_waiters;
+		fair_lock_cond_timedwait(&bq->not_full_cond, &bq->mutex, deadline_ns);
+		--bq->not_full_waiters;
+		if (bq->collect_stats) {
+			__atomic_store_n(&bq->stats_not_full_blocked_ns, bq->stats_not_full_blocked_ns + (fair_lock_now_ns() - blocked_start),
+				__ATOMIC_RELAXED);
+		}
+	}
+	BQ_PROBE2(unblock, bq, 1);
+	BQ_WAIT_END(bq, wait_start, BQ_WAIT_NOT_FULL);
+	return 0;
+}
+
+// Blocks the caller (which holds the 'get_lock') until the queue may have elements, or until 'deadline_ns' (see
+// 'wait_not_full').
+// Must be called with 'bq->mutex' held. Callers must re-check the queue when this function returns.
+// Returns BQ_TIMEOUT, without waiting, if the deadline already passed. Returns 0 otherwise.
+static int wait_not_empty(Blocking_Queue* bq, unsigned long long deadline_ns) {
+	if (deadline_ns && fair_lock_now_ns() >= deadline_ns) {
+		return BQ_TIMEOUT;
+	}
+	if (!bq->get_lock_are_weak_locks_blocked) {
+		fair_lock_block_weak_locks(&bq->get_lock);
+		bq->get_lock_are_weak_locks_blocked = 1;
+	}
+	BQ_WAIT_BEGIN(wait_start);
+	BQ_PROBE2(block, bq, 0);
+	if (!spin_before_wait(bq)) {
+		unsigned long long blocked_start = bq->collect_stats ? fair_lock_now_ns() : 0;
+		++bq->not_empty_waiters;
+		fair_lock_cond_timedwait(&bq->not_empty_cond, &bq->mutex, deadline_ns);
+		--bq->not_empty_waiters;
+		if (bq->collect_stats) {
+			__atomic_store_n(&bq->stats_not_empty_blocked_ns, bq->stats_not_empty_blocked_ns + (fair_lock_now_ns() - blocked_start),
+				__ATOMIC_RELAXED);
+		}
+	}
+	BQ_PROBE2(unblock, bq, 0);
+	BQ_WAIT_END(bq, wait_start, BQ_WAIT_NOT_EMPTY);
+	return 0;
+}
+
+// Blocks the caller (which holds the 'get_lock' and is accumulating a batch) until more elements may have been added, or until
+// 'deadline_ns' (0 means no deadline). The queue is not empty, so weak locks stay allowed and the wait is not reported as blocked.
+// Must be called with 'bq->mutex' held. Callers must re-check the queue when this function returns.
+// Returns BQ_TIMEOUT, without waiting, if the deadline already passed. Returns 0 otherwise.
+static int wait_linger(Blocking_Queue* bq, unsigned long long deadline_ns) {
+	if (deadline_ns && fair_lock_now_ns() >= deadline_ns) {
+		return BQ_TIMEOUT;
+	}
+	++bq->not_empty_waiters;
+	fair_lock_cond_timedwait(&bq->not_empty_cond, &bq->mutex, deadline_ns);
+	--bq->not_empty_waiters;
 	return 0;
 }
 
-int blocking_queue_add_internal(Blocking_Queue* bq, void* element, int async) {
+// Adds 'n' elements to the queue, holding the 'add_lock' during the whole call, so the elements are added contiguously.
+// If 'async' is true, adds as many elements as possible without blocking. Otherwise, blocks until all elements are added, or
+// until 'deadline_ns' (see 'fair_lock_now_ns', 0 means no deadline) is reached, in which case BQ_TIMEOUT is returned.
+// The number of elements actually added is stored in '*count', if 'count' is not NULL.
+int blocking_queue_add_internal(Blocking_Queue* bq, const void* elements, unsigned int n, int async, unsigned long long deadline_ns,
+	unsigned int* count) {
+	unsigned int added = 0;
+	if (count) {
+		*count = 0;
+	}
+	if (n == 0) {
+		return 0;
+	}
+
+	// Lock-free early-out: 'closed' and 'queue_size' are published atomically, so a non-blocking call that cannot succeed fails
+	// without touching any lock. Only calls that may succeed go through the fair lock (and re-check everything there).
+	if (async) {
+		if (__atomic_load_n(&bq->closed, __ATOMIC_RELAXED)) {
+			return BQ_CLOSED;
+		}
+		if (!bq->is_boundless && __atomic_load_n(&bq->queue_size, __ATOMIC_RELAXED) == bq->queue_capacity) {
+			if (bq->collect_stats) {
+				__atomic_add_fetch(&bq->stats_full_rejections, 1, __ATOMIC_RELAXED);
+			}
+			return BQ_FULL;
+		}
+	}
+
 	increase_active_callers_count(bq);
 
+	BQ_WAIT_BEGIN(lock_start);
 	int lock_ret;
 	if (async) {
 		lock_ret = fair_lock_lock_weak(&bq->add_lock);
 	} else {
-		lock_ret = fair_lock_lock(&bq->add_lock);
+		lock_ret = fair_lock_lock_timed(&bq->add_lock, deadline_ns);
 	}
+	BQ_WAIT_END(bq, lock_start, BQ_WAIT_ADD_LOCK);
 
 	//assert(lock_ret == 0 || lock_ret == FL_ERROR || lock_ret == FL_ABANDONED);
 
 	if (lock_ret == FL_ERROR) {
 		decrease_active_callers_count(bq);
 		return BQ_ERROR;
+	} else if (lock_ret == FL_TIMEOUT) {
+		decrease_active_callers_count(bq);
+		return BQ_TIMEOUT;
 	} else if (lock_ret == FL_ABANDONED) {
 		decrease_active_callers_count(bq);
+		// Abandoned because the queue was closed, or (weak locks only) because it became full
+		if (__atomic_load_n(&bq->closed, __ATOMIC_RELAXED)) {
+			return BQ_CLOSED;
+		}
+		if (bq->collect_stats) {
+			__atomic_add_fetch(&bq->stats_full_rejections, 1, __ATOMIC_RELAXED);
+		}
 		return BQ_FULL;
 	}
 
 	pthread_mutex_lock(&bq->mutex);
 
-	if (bq->closed) {
-		fair_lock_unlock(&bq->add_lock);
-		pthread_mutex_unlock(&bq->mutex);
-		decrease_active_callers_count(bq);
-		return BQ_CLOSED;
-	}
+	int ret = 0;
+	while (1) {
+		if (bq->closed) {
+			ret = BQ_CLOSED;
+			break;
+		}
 
-	if (bq->queue_size == bq->queue_capacity) {
 		if (bq->is_boundless) {
-			if (grow_queue(bq)) {
-				fair_lock_unlock(&bq->add_lock);
-				pthread_mutex_unlock(&bq->mutex);
-				decrease_active_callers_count(bq);
-				return BQ_ERROR;
+			grow_to_fit(bq, n - added);
+		}
+
+		unsigned int chunk = bq->queue_capacity - bq->queue_size;
+		if (chunk > n - added) {
+			chunk = n - added;
+		}
+
+		if (chunk > 0) {
+			const unsigned char* first_element = (const unsigned char*)elements + (size_t)added * bq->element_size;
+			enqueue_n(bq, first_element, chunk);
+			elements_added(bq, first_element, chunk);
+			added += chunk;
+			if (added == n) {
+				break;
 			}
-		} else {
-			if (!bq->add_lock_are_weak_locks_blocked) {
+		}
+
+		if (bq->is_boundless) {
+			// Growing the queue failed
+			ret = BQ_ERROR;
+			break;
+		}
+
+		if (async) {
+			if (bq->queue_size == bq->queue_capacity && !bq->add_lock_are_weak_locks_blocked) {
 				fair_lock_block_weak_locks(&bq->add_lock);
 				bq->add_lock_are_weak_locks_blocked = 1;
 			}
-			if (async) {
-				fair_lock_unlock(&bq->add_lock);
-				pthread_mutex_unlock(&bq->mutex);
-				decrease_active_callers_count(bq);
-				return BQ_FULL;
-			}
-			pthread_cond_wait(&bq->cond, &bq->mutex);
-			if (bq->closed) {
-				fair_lock_unlock(&bq->add_lock);
-				pthread_mutex_unlock(&bq->mutex);
-				decrease_active_callers_count(bq);
-				return BQ_CLOSED;
+			if (added == 0) {
+				ret = BQ_FULL;
+				if (bq->collect_stats) {
+					__atomic_add_fetch(&bq->stats_full_rejections, 1, __ATOMIC_RELAXED);
+				}
 			}
-			//assert(bq->queue_size < bq->queue_capacity);
+			break;
+		}
+		ret = wait_not_full(bq, deadline_ns);
+		if (ret) {
+			break;
 		}
 	}
-	if (bq->get_lock_are_weak_locks_blocked) {
-		fair_lock_allow_weak_locks(&bq->get_lock);
-		bq->get_lock_are_weak_locks_blocked = 0;
-	}
-	pthread_cond_signal(&bq->cond);
-	enqueue(bq, element);
 	pthread_mutex_unlock(&bq->mutex);
 
 	fair_lock_unlock(&bq->add_lock);
 
 	decrease_active_callers_count(bq);
 
-	return 0;
+	if (count) {
+		*count = added;
+	}
+	return ret;
 }
 
-int blocking_queue_get_internal(Blocking_Queue* bq, int async, void* element) {
+// Gets 'n' elements from the queue, holding the 'get_lock' during the whole call, so the elements are taken contiguously.
+// If 'async' is true, gets as many elements as possible without blocking. Otherwise, blocks until all elements are taken, or
+// until 'deadline_ns' (see 'fair_lock_now_ns', 0 means no deadline) is reached, in which case BQ_TIMEOUT is returned.
+// If 'batch' is true (blocking calls only), the elements are taken as a batch instead: once at least one element is available,
+// waits up to 'linger_ns' for 'n' of them (see 'blocking_queue_deadline_after'), and then takes all the available ones (up to
+// 'n') at once.
+// The number of elements actually taken is stored in '*count', if 'count' is not NULL.
+int blocking_queue_get_internal(Blocking_Queue* bq, void* elements, unsigned int n, int async, unsigned long long deadline_ns,
+	int batch, unsigned long long linger_ns, unsigned int* count) {
+	unsigned int taken = 0;
+	if (count) {
+		*count = 0;
+	}
+	if (n == 0) {
+		return 0;
+	}
+
+	// Lock-free early-out, see 'blocking_queue_add_internal'
+	if (async) {
+		if (__atomic_load_n(&bq->closed, __ATOMIC_RELAXED)) {
+			return BQ_CLOSED;
+		}
+		if (__atomic_load_n(&bq->queue_size, __ATOMIC_RELAXED) == 0) {
+			if (bq->collect_stats) {
+				__atomic_add_fetch(&bq->stats_empty_rejections, 1, __ATOMIC_RELAXED);
+			}
+			return BQ_EMPTY;
+		}
+	}
+
 	increase_active_callers_count(bq);
 
+	BQ_WAIT_BEGIN(lock_start);
 	int lock_ret;
 	if (async) {
 		lock_ret = fair_lock_lock_weak(&bq->get_lock);
 	} else {
-		lock_ret = fair_lock_lock(&bq->get_lock);
+		lock_ret = fair_lock_lock_timed(&bq->get_lock, deadline_ns);
 	}
+	BQ_WAIT_END(bq, lock_start, BQ_WAIT_GET_LOCK);
 
 	if (lock_ret == FL_ERROR) {
 		decrease_active_callers_count(bq);
 		return BQ_ERROR;
+	} else if (lock_ret == FL_TIMEOUT) {
+		decrease_active_callers_count(bq);
+		return BQ_TIMEOUT;
 	} else if (lock_ret == FL_ABANDONED) {
 		decrease_active_callers_count(bq);
+		// Abandoned because the queue was closed, or (weak locks only) because it became empty
+		if (__atomic_load_n(&bq->closed, __ATOMIC_RELAXED)) {
+			return BQ_CLOSED;
+		}
+		if (bq->collect_stats) {
+			__atomic_add_fetch(&bq->stats_empty_rejections, 1, __ATOMIC_RELAXED);
+		}
 		return BQ_EMPTY;
 	}
 
@@ -494,62 +1636,301 @@ int blocking_queue_get_internal(Blocking_Queue* bq, int async, void* element) {
 
 	pthread_mutex_lock(&bq->mutex);
 
-	if (bq->closed) {
-		fair_lock_unlock(&bq->get_lock);
-		pthread_mutex_unlock(&bq->mutex);
+	int ret = 0;
+	// When batching, set once the first element is available
+	int lingering = 0;
+	unsigned long long linger_deadline_ns = 0;
+	while (1) {
+		if (bq->closed) {
+			ret = BQ_CLOSED;
+			break;
+		}
+
+		unsigned int chunk = bq->queue_size;
+		if (chunk > n - taken) {
+			chunk = n - taken;
+		}
+
+		// Keep accumulating elements in the queue until there are enough of them or the linger expires. There is no point in
+		// waiting once a bounded queue is full: producers cannot add anything else until we take.
+		if (batch && linger_ns && chunk > 0 && chunk < n && (bq->is_boundless || bq->queue_size < bq->queue_capacity)) {
+			if (!lingering) {
+				lingering = 1;
+				linger_deadline_ns = blocking_queue_deadline_after(linger_ns);
+			}
+			if (!wait_linger(bq, linger_deadline_ns)) {
+				continue;
+			}
+		}
+
+		if (chunk > 0) {
+			unsigned char* first_element = (unsigned char*)elements + (size_t)taken * bq->element_size;
+			dequeue_n(bq, first_element, chunk);
+			elements_taken(bq, first_element, chunk);
+			taken += chunk;
+			if (taken == n || batch) {
+				break;
+			}
+		}
+
+		if (async) {
+			if (!bq->get_lock_are_weak_locks_blocked) {
+				fair_lock_block_weak_locks(&bq->get_lock);
+				bq->get_lock_are_weak_locks_blocked = 1;
+			}
+			if (taken == 0) {
+				ret = BQ_EMPTY;
+				if (bq->collect_stats) {
+					__atomic_add_fetch(&bq->stats_empty_rejections, 1, __ATOMIC_RELAXED);
+				}
+			}
+			break;
+		}
+		ret = wait_not_empty(bq, deadline_ns);
+		if (ret) {
+			break;
+		}
+	}
+	Blocking_Queue_Segment* segments_to_free = take_segments_to_free(bq);
+	pthread_mutex_unlock(&bq->mutex);
+
+	free_segment_list(bq, segments_to_free);
+	fair_lock_unlock(&bq->get_lock);
+
+	decrease_active_callers_count(bq);
+
+	if (count) {
+		*count = taken;
+	}
+	return ret;
+}
+
+// Takes the turn in the FIFO of callers for 'lock' (strongly, as in put/take).
+// Returns 0 if success, BQ_CLOSED or BQ_ERROR otherwise (in which case the caller is no longer counted as active).
+static int lock_for_in_place_call(Blocking_Queue* bq, Fair_Lock* lock, int kind) {
+	increase_active_callers_count(bq);
+
+	BQ_WAIT_BEGIN(lock_start);
+	int lock_ret = fair_lock_lock(lock);
+	BQ_WAIT_END(bq, lock_start, kind);
+	(void)kind;
+
+	if (lock_ret) {
 		decrease_active_callers_count(bq);
-		return BQ_CLOSED;
+		return lock_ret == FL_ABANDONED ? BQ_CLOSED : BQ_ERROR;
+	}
+	return 0;
+}
+
+int blocking_queue_reserve_put(Blocking_Queue* bq, void** slot) {
+	*slot = NULL;
+	int ret = lock_for_in_place_call(bq, &bq->add_lock, BQ_WAIT_ADD_LOCK);
+	if (ret) {
+		return ret;
 	}
 
-	if (bq->queue_size == 0) {
-		if (!bq->get_lock_are_weak_locks_blocked) {
-			fair_lock_block_weak_locks(&bq->get_lock);
-			bq->get_lock_are_weak_locks_blocked = 1;
+	pthread_mutex_lock(&bq->mutex);
+
+	while (1) {
+		if (bq->closed) {
+			ret = BQ_CLOSED;
+			break;
 		}
-		if (async) {
-			fair_lock_unlock(&bq->get_lock);
-			pthread_mutex_unlock(&bq->mutex);
-			decrease_active_callers_count(bq);
-			return BQ_EMPTY;
+
+		if (bq->is_boundless) {
+			grow_to_fit(bq, 1);
+		}
+
+		if (bq->queue_size < bq->queue_capacity) {
+			*slot = rear_slot_address(bq);
+			break;
+		}
+
+		if (bq->is_boundless) {
+			// Growing the queue failed
+			ret = BQ_ERROR;
+			break;
 		}
-		pthread_cond_wait(&bq->cond, &bq->mutex);
+
+		wait_not_full(bq, 0);
+	}
+
+	pthread_mutex_unlock(&bq->mutex);
+
+	if (ret) {
+		fair_lock_unlock(&bq->add_lock);
+		decrease_active_callers_count(bq);
+	}
+
+	return ret;
+}
+
+void blocking_queue_commit_put(Blocking_Queue* bq) {
+	pthread_mutex_lock(&bq->mutex);
+	// The slot was already written by the caller, so only the indexes are updated
+	const void* element = rear_slot_address(bq);
+	advance_rear(bq);
+	elements_added(bq, element, 1);
+	pthread_mutex_unlock(&bq->mutex);
+
+	fair_lock_unlock(&bq->add_lock);
+	decrease_active_callers_count(bq);
+}
+
+int blocking_queue_acquire_take(Blocking_Queue* bq, void** slot) {
+	*slot = NULL;
+	int ret = lock_for_in_place_call(bq, &bq->get_lock, BQ_WAIT_GET_LOCK);
+	if (ret) {
+		return ret;
+	}
+
+	pthread_mutex_lock(&bq->mutex);
+
+	while (1) {
 		if (bq->closed) {
-			fair_lock_unlock(&bq->get_lock);
-			pthread_mutex_unlock(&bq->mutex);
-			decrease_active_callers_count(bq);
-			return BQ_CLOSED;
+			ret = BQ_CLOSED;
+			break;
 		}
-		//assert(bq->queue_size >= 1);
+
+		if (bq->queue_size > 0) {
+			*slot = front_slot_address(bq);
+			break;
+		}
+
+		wait_not_empty(bq, 0);
 	}
-	if (bq->add_lock_are_weak_locks_blocked) {
-		fair_lock_allow_weak_locks(&bq->add_lock);
-		bq->add_lock_are_weak_locks_blocked = 0;
+
+	pthread_mutex_unlock(&bq->mutex);
+
+	if (ret) {
+		fair_lock_unlock(&bq->get_lock);
+		decrease_active_callers_count(bq);
 	}
-	pthread_cond_signal(&bq->cond);
-	*(void**)element = dequeue(bq);
+
+	return ret;
+}
+
+void blocking_queue_release_take(Blocking_Queue* bq) {
+	pthread_mutex_lock(&bq->mutex);
+	const void* element = front_slot_address(bq);
+	advance_front(bq);
+	elements_taken(bq, element, 1);
+	Blocking_Queue_Segment* segments_to_free = take_segments_to_free(bq);
 	pthread_mutex_unlock(&bq->mutex);
 
-	fair_lock_unlock(&bq->get_lock);
+	free_segment_list(bq, segments_to_free);
 
+	fair_lock_unlock(&bq->get_lock);
 	decrease_active_callers_count(bq);
+}
 
-	return 0;
+unsigned long long blocking_queue_trim(Blocking_Queue* bq) {
+	if (!bq->is_boundless) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&bq->mutex);
+	unsigned int count = bq->free_segments_count;
+	Blocking_Queue_Segment* segments = detach_free_segments(bq, 0);
+	pthread_mutex_unlock(&bq->mutex);
+
+	free_segment_list(bq, segments);
+	return segments ? (unsigned long long)count * segment_footprint(bq) : 0;
+}
+
+unsigned long long blocking_queue_get_footprint(Blocking_Queue* bq) {
+	if (!bq->is_boundless) {
+		return (unsigned long long)bq->queue_capacity * bq->element_size;
+	}
+	return (unsigned long long)__atomic_load_n(&bq->segments_count, __ATOMIC_RELAXED) * segment_footprint(bq);
 }
 
 int blocking_queue_add(Blocking_Queue* bq, void* element) {
-	return blocking_queue_add_internal(bq, element, 1);
+	return blocking_queue_add_internal(bq, bq->is_sized ? element : &element, 1, 1, 0, NULL);
 }
 
 int blocking_queue_put(Blocking_Queue* bq, void* element) {
-	return blocking_queue_add_internal(bq, element, 0);
+	return blocking_queue_add_internal(bq, bq->is_sized ? element : &element, 1, 0, 0, NULL);
 }
 
 int blocking_queue_poll(Blocking_Queue* bq, void* element) {
-	return blocking_queue_get_internal(bq, 1, element);
+	return blocking_queue_get_internal(bq, element, 1, 1, 0, 0, 0, NULL);
 }
 
 int blocking_queue_take(Blocking_Queue* bq, void* element) {
-	return blocking_queue_get_internal(bq, 0, element);
+	return blocking_queue_get_internal(bq, element, 1, 0, 0, 0, 0, NULL);
+}
+
+int blocking_queue_put_timed(Blocking_Queue* bq, void* element, unsigned long long timeout_ns) {
+	unsigned long long deadline_ns = blocking_queue_deadline_after(timeout_ns);
+	return blocking_queue_add_internal(bq, bq->is_sized ? element : &element, 1, 0, deadline_ns, NULL);
+}
+
+int blocking_queue_put_until(Blocking_Queue* bq, void* element, unsigned long long deadline_ns) {
+	// A deadline of 0 would mean no deadline
+	return blocking_queue_add_internal(bq, bq->is_sized ? element : &element, 1, 0, deadline_ns ? deadline_ns : 1, NULL);
+}
+
+int blocking_queue_take_timed(Blocking_Queue* bq, void* element, unsigned long long timeout_ns) {
+	return blocking_queue_get_internal(bq, element, 1, 0, blocking_queue_deadline_after(timeout_ns), 0, 0, NULL);
+}
+
+int blocking_queue_take_until(Blocking_Queue* bq, void* element, unsigned long long deadline_ns) {
+	return blocking_queue_get_internal(bq, element, 1, 0, deadline_ns ? deadline_ns : 1, 0, 0, NULL);
+}
+
+int blocking_queue_add_n(Blocking_Queue* bq, void** elements, unsigned int n, unsigned int* added) {
+	return blocking_queue_add_internal(bq, elements, n, 1, 0, added);
+}
+
+int blocking_queue_put_n(Blocking_Queue* bq, void** elements, unsigned int n, unsigned int* added) {
+	return blocking_queue_add_internal(bq, elements, n, 0, 0, added);
+}
+
+int blocking_queue_poll_n(Blocking_Queue* bq, void** elements, unsigned int n, unsigned int* polled) {
+	return blocking_queue_get_internal(bq, elements, n, 1, 0, 0, 0, polled);
+}
+
+int blocking_queue_take_n(Blocking_Queue* bq, void** elements, unsigned int n, unsigned int* taken) {
+	return blocking_queue_get_internal(bq, elements, n, 0, 0, 0, 0, taken);
+}
+
+int blocking_queue_take_batch(Blocking_Queue* bq, void** elements, unsigned int max_n, unsigned long long linger_ns,
+	unsigned int* taken) {
+	return blocking_queue_get_internal(bq, elements, max_n, 0, 0, 1, linger_ns, taken);
+}
+
+void blocking_queue_get_spin_stats(Blocking_Queue* bq, Blocking_Queue_Spin_Stats* stats) {
+	unsigned long long successes, failures;
+	stats->wait_spin_successes = __atomic_load_n(&bq->wait_spin_successes, __ATOMIC_RELAXED);
+	stats->wait_spin_failures = __atomic_load_n(&bq->wait_spin_failures, __ATOMIC_RELAXED);
+	fair_lock_get_spin_stats(&bq->get_lock, &successes, &failures);
+	stats->lock_spin_successes = successes;
+	stats->lock_spin_failures = failures;
+	fair_lock_get_spin_stats(&bq->add_lock, &successes, &failures);
+	stats->lock_spin_successes += successes;
+	stats->lock_spin_failures += failures;
+}
+
+void blocking_queue_get_wakeup_stats(Blocking_Queue* bq, Blocking_Queue_Wakeup_Stats* stats) {
+	stats->wakeups_signaled = __atomic_load_n(&bq->wakeups_signaled, __ATOMIC_RELAXED);
+	stats->wakeups_elided = __atomic_load_n(&bq->wakeups_elided, __ATOMIC_RELAXED);
+}
+
+void blocking_queue_get_stats(Blocking_Queue* bq, Blocking_Queue_Stats* stats) {
+	stats->puts = __atomic_load_n(&bq->stats_puts, __ATOMIC_RELAXED);
+	stats->takes = __atomic_load_n(&bq->stats_takes, __ATOMIC_RELAXED);
+	stats->full_rejections = __atomic_load_n(&bq->stats_full_rejections, __ATOMIC_RELAXED);
+	stats->empty_rejections = __atomic_load_n(&bq->stats_empty_rejections, __ATOMIC_RELAXED);
+	stats->grow_events = __atomic_load_n(&bq->stats_grow_events, __ATOMIC_RELAXED);
+	stats->shrink_events = __atomic_load_n(&bq->stats_shrink_events, __ATOMIC_RELAXED);
+	stats->max_queue_size = __atomic_load_n(&bq->stats_max_queue_size, __ATOMIC_RELAXED);
+	stats->not_full_blocked_ns = __atomic_load_n(&bq->stats_not_full_blocked_ns, __ATOMIC_RELAXED);
+	stats->not_empty_blocked_ns = __atomic_load_n(&bq->stats_not_empty_blocked_ns, __ATOMIC_RELAXED);
+	stats->max_add_lock_waiting_threads = fair_lock_get_max_waiting_threads(&bq->add_lock);
+	stats->max_get_lock_waiting_threads = fair_lock_get_max_waiting_threads(&bq->get_lock);
+	blocking_queue_get_spin_stats(bq, &stats->spin);
+	blocking_queue_get_wakeup_stats(bq, &stats->wakeups);
 }
 
 #endif
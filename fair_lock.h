@@ -35,6 +35,34 @@
 	This fair lock is very similar to pthread's fair lock. The difference is that all blocked callers are served in FIFO order.
 
 	This fair lock also provides "weak locks", which are locks that can be given up. Check the API for details.
+	Weak and strong callers wait in separate queues, merged in arrival order when the lock is handed over. Blocking weak locks
+	drops the whole weak queue in O(1) and wakes all weak callers with a single wake-up, no matter how many are waiting.
+
+	When the lock is free and nobody is waiting for it, locking and unlocking is a single CAS. The internal mutex and the FIFO queue
+	of callers are only used once there is contention.
+
+	Blocked callers may optionally spin for a while before parking (see 'fair_lock_set_spin_policy'), which avoids a sleep/wake-up
+	cycle when the lock is expected to be handed over soon.
+
+	Callers may also give up waiting at a deadline (see 'fair_lock_lock_timed'). A caller that times out unlinks itself from the
+	queue, so the callers behind it keep their order.
+
+	On Linux, blocked callers sleep on a futex word stored in their queue entry, and unlocking hands the lock over directly to the
+	next caller in the queue with a single FUTEX_WAKE. The woken caller already owns the lock, so it does not need to reacquire the
+	internal mutex. Weak callers sleep on a futex word shared by the lock instead, each one selecting a channel in the futex bitset.
+	On kernels with futex_waitv (Linux 5.16+), strong callers also watch a word shared by the lock, so closing the lock wakes all of
+	them up at once.
+	Define C_FEK_FAIR_LOCK_NO_FUTEX to use a pthread cond per queue entry (and one per channel for weak callers) instead (this is
+	always the case on other platforms).
+
+	Define C_FEK_FAIR_LOCK_USDT to compile static tracepoints (USDT probes, requires <sys/sdt.h> from systemtap-sdt-dev) into
+	the implementation. They are a single nop when nobody is tracing, and can be attached to with perf or bpftrace, e.g.
+	'bpftrace -e "usdt:./a.out:c_fek_fair_lock:wait__end { ... }"'. The probes (provider 'c_fek_fair_lock') are:
+	* wait__begin(lock, weak, waiting_threads): a caller could not get the lock and joined the queue
+	* wait__end(lock, result): the caller left the queue with the lock (result 0), because it was abandoned (FL_ABANDONED) or
+	  because it timed out (FL_TIMEOUT)
+	* abandon__weak(lock, abandoned_count): weak callers were abandoned by 'fair_lock_block_weak_locks'
+	When C_FEK_FAIR_LOCK_USDT is not defined, the probes are not compiled at all.
 
 	Define C_FEK_FAIR_LOCK_QUEUE_NO_CRT if you don't want the C Runtime Library included. If this is defined, you must provide
 	implementations for the following functions:
@@ -42,48 +70,164 @@
 	void* malloc(unsigned int size)
 	void  free(void* block)
 
+	To allocate the memory of a lock with something else than the C Runtime Library (an arena, a pool, etc.) in a per-lock basis,
+	initialize it with 'fair_lock_init_with_allocator'.
+
 	For more information about the API, check the comments in the function signatures.
 
 	https://github.com/felipeek/c-fifo-blocking-queue
 */
 
 #include <pthread.h>
+#include <stddef.h>
+#include <time.h>
+#include <errno.h>
 
 #define FL_ERROR 1
 #define FL_ABANDONED 2
+#define FL_TIMEOUT 3
+
+#if defined(__linux__) && !defined(C_FEK_FAIR_LOCK_NO_FUTEX)
+#define C_FEK_FAIR_LOCK_USE_FUTEX
+#endif
+
+// Parked weak callers are split into this many channels, by ticket. Handing the lock over to a weak caller wakes up its whole
+// channel (the others go back to sleep), while abandoning weak callers wakes up all channels at once.
+#if defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+#define FL_WEAK_CHANNELS 32
+#else
+#define FL_WEAK_CHANNELS 8
+#endif
+
+// Spin-then-park policy for callers that must wait. A zeroed policy disables spinning.
+typedef struct {
+	// Maximum number of times a waiting caller re-checks whether it can proceed before parking. 0 disables spinning.
+	unsigned int max_iterations;
+	// Maximum time spent spinning before parking, in nanoseconds. 0 means that only 'max_iterations' applies.
+	unsigned long long max_ns;
+} Fair_Lock_Spin_Policy;
+
+// Allocator used for the memory of a lock (see 'fair_lock_init_with_allocator'). Also used by blocking_queue.h.
+// A zeroed structure means the C Runtime Library (malloc/realloc/free). 'alloc' and 'free' must be both set or both NULL.
+typedef struct {
+	// Allocates 'size' bytes, aligned as malloc would. Returns NULL on failure.
+	void* (*alloc)(void* ctx, size_t size);
+	// Resizes 'block' from 'old_size' to 'new_size' bytes. Returns NULL on failure, in which case 'block' is left untouched.
+	// Optional: if NULL, resizing allocates a new block with 'alloc', copies the contents and frees the old block with 'free'
+	// (see 'fair_lock_allocator_realloc'). The locks and queues never resize a block themselves today (boundless queues grow by
+	// linking fixed-size segments), so this only matters for code resizing its blocks with that function.
+	void* (*realloc)(void* ctx, void* block, size_t old_size, size_t new_size);
+	// Frees 'block', which was allocated with 'size' bytes
+	void (*free)(void* ctx, void* block, size_t size);
+	// Passed as is to the functions above
+	void* ctx;
+} Fair_Lock_Allocator;
+
+// This structure is reserved for internal-use only
+typedef struct {
+	const Fair_Lock_Spin_Policy* policy;
+	unsigned int iterations;
+	unsigned int backoff;
+	unsigned long long deadline_ns;
+} Fair_Lock_Spinner;
 
 // This structure is reserved for internal-use only
 typedef struct Cond_Queue_Entry {
+#if !defined(C_FEK_FAIR_LOCK_USE_FUTEX)
 	pthread_cond_t cond;
+#endif
+	// State of the caller bound to this entry (FL_ENTRY_WAITING, FL_ENTRY_PARKED, FL_ENTRY_GRANTED or FL_ENTRY_ABANDONED).
+	// When using futexes, strong callers sleep on this word.
+	unsigned int state;
 	// If true, this entry is bound to a weak lock
 	int weak;
-	// If true, the lock bound to this entry was abandoned
-	int abandoned;
+	// Order in which the caller joined the queues, shared by weak and strong callers
+	unsigned long long ticket;
+	// Value of 'weak_generation' when the caller joined the queue. Only used by weak callers.
+	unsigned int generation;
 	struct Cond_Queue_Entry* next;
+	// Only kept up to date while the entry is in its queue, so a caller that times out can unlink itself in O(1)
+	struct Cond_Queue_Entry* prev;
 } Cond_Queue_Entry;
 
+// This structure is reserved for internal-use only
+typedef struct {
+	Cond_Queue_Entry* front;
+	Cond_Queue_Entry* rear;
+} Cond_Queue;
+
 // This structure is reserved for internal-use only
 typedef struct Fair_Lock {
 	// Internal Mutex
 	pthread_mutex_t mutex;
-	// The first Cond_Queue_Entry in the lock queue
-	Cond_Queue_Entry* cond_queue_front;
-	// The last Cond_Queue_Entry in the lock queue
-	Cond_Queue_Entry* cond_queue_rear;
+	// Callers waiting in 'fair_lock_lock', in FIFO order
+	Cond_Queue strong_queue;
+	// Callers waiting in 'fair_lock_lock_weak', in FIFO order.
+	// The lock is handed over to whichever front entry of both queues has the lowest ticket.
+	Cond_Queue weak_queue;
+	// Ticket of the next caller that joins one of the queues
+	unsigned long long next_ticket;
 	// Pool of already-allocated Cond_Queue_Entry structures
 	Cond_Queue_Entry* cond_pool;
-	// Specifies whether the lock is currently owned by a thread
-	int is_lock_acquired;
+	// Entry of the caller that received the lock from 'fair_lock_unlock'. It is given back to the pool when the lock is unlocked.
+	Cond_Queue_Entry* owner_entry;
+	// FL_STATE_UNLOCKED, FL_STATE_LOCKED or FL_STATE_CONTENDED.
+	// Accessed atomically: the uncontended lock/unlock only CAS this word, without taking 'mutex'.
+	unsigned int state;
 	// Number of threads waiting for the lock.
-	// Threads bound to lock requests that were abandoned, but are still waiting their turn, are not counted.
+	// Threads bound to lock requests that were abandoned are not counted.
 	int waiting_threads;
+	// Peak value of 'waiting_threads'. Protected by 'mutex', read atomically.
+	int max_waiting_threads;
+	// Number of callers in 'weak_queue'
+	int weak_waiting_threads;
+	// Incremented every time weak callers are abandoned. Weak callers that joined the queue in an older generation, and were not
+	// handed over the lock, were abandoned. Protected by 'mutex', read atomically.
+	unsigned int weak_generation;
+#if defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+	// Parked weak callers sleep on this word, each one with its channel in the futex bitset. Incremented before waking them.
+	unsigned int weak_futex;
+	// Incremented by 'fair_lock_close'. If 'use_futex_waitv' is true, parked strong callers also sleep on this word.
+	unsigned int close_futex;
+	// If true, strong callers wait on both their entry and 'close_futex' with futex_waitv
+	int use_futex_waitv;
+#else
+	// Parked weak callers wait on the cond of their channel
+	pthread_cond_t weak_conds[FL_WEAK_CHANNELS];
+#endif
 	// If true, weak locks should be discarded.
 	int block_weak_locks;
+	// If true, the lock was closed by 'fair_lock_close': callers that would have to wait are rejected, and strong callers that
+	// were waiting are abandoned. Written while holding 'mutex', read atomically.
+	int closed;
+	// How blocked callers spin before parking
+	Fair_Lock_Spin_Policy spin_policy;
+	// Number of blocked callers that got the lock while spinning. Updated atomically.
+	unsigned long long spin_successes;
+	// Number of blocked callers that had to park after spinning. Updated atomically.
+	unsigned long long spin_failures;
+	// Allocator of the Cond_Queue_Entry structures
+	Fair_Lock_Allocator allocator;
 } Fair_Lock;
 
+// Resizes 'block' (allocated by 'allocator' with 'old_size' bytes) to 'new_size' bytes, keeping its contents.
+// Uses the 'realloc' callback if set, or falls back to 'alloc' + copy + 'free'. If 'allocator' is NULL or zeroed, the C Runtime
+// Library is used.
+// Returns the resized block, or NULL on failure, in which case 'block' is left untouched.
+void* fair_lock_allocator_realloc(const Fair_Lock_Allocator* allocator, void* block, size_t old_size, size_t new_size);
 // Initializes the fair lock.
 // Returns 0 if success, FL_ERROR otherwise.
 int fair_lock_init(Fair_Lock* lock);
+// Initializes the fair lock, just like 'fair_lock_init', but allocating its memory with 'allocator' (see 'Fair_Lock_Allocator').
+// The allocator is copied. If 'allocator' is NULL, the C Runtime Library is used.
+// Returns 0 if success, FL_ERROR otherwise.
+int fair_lock_init_with_allocator(Fair_Lock* lock, const Fair_Lock_Allocator* allocator);
+// Initializes the fair lock, just like 'fair_lock_init_with_allocator', but also preallocating the structures needed by 'capacity'
+// callers waiting for the lock at the same time (one per thread, counting the one that holds the lock).
+// As long as there are no more than 'capacity' such threads, 'fair_lock_lock' and 'fair_lock_lock_weak' never allocate memory,
+// so they cannot fail with FL_ERROR.
+// Returns 0 if success, FL_ERROR otherwise.
+int fair_lock_init_with_capacity(Fair_Lock* lock, unsigned int capacity, const Fair_Lock_Allocator* allocator);
 // Destroys the fair lock.
 // A fair lock can only be destroyed if nobody currently holds the lock.
 // After destroyed, the lock cannot be used anymore.
@@ -91,9 +235,15 @@ void fair_lock_destroy(Fair_Lock* lock);
 // The fair lock is locked.
 // If the fair lock is already locked, the calling thread blocks until the fair lock becomes available.
 // FIFO order is guaranteed - callers will never suffer from starvation.
-// This function may alloc memory. If there is no memory available, it will fail.
-// Returns 0 if success, FL_ERROR otherwise.
+// This function may alloc memory. If there is no memory available, it will fail (see 'fair_lock_init_with_capacity').
+// Returns 0 if success, FL_ERROR if error and FL_ABANDONED if the lock was closed (see 'fair_lock_close').
 int fair_lock_lock(Fair_Lock *lock);
+// Behavior is equal to 'fair_lock_lock', but the caller gives up waiting once 'deadline_ns' is reached. The deadline is absolute,
+// in the clock of 'fair_lock_now_ns' (CLOCK_MONOTONIC). A deadline of 0 means no deadline.
+// A caller that times out leaves the queue without disturbing the order of the callers behind it. The lock is still acquired if
+// it is free, even if the deadline already passed.
+// Returns 0 if success, FL_ERROR if error, FL_ABANDONED if the lock was closed and FL_TIMEOUT if the deadline was reached.
+int fair_lock_lock_timed(Fair_Lock *lock, unsigned long long deadline_ns);
 // The fair lock is unlocked.
 // *Can only be called if the lock is held by the caller*
 void fair_lock_unlock(Fair_Lock *lock);
@@ -103,190 +253,822 @@ void fair_lock_unlock(Fair_Lock *lock);
 // Note that if the caller calls this function when weak locks are not blocked, but then someone blocks weak locks while
 // that thread was still blocked waiting for the lock to be acquired, this function will immediately return with FL_ABANDONED,
 // even though the call was made when weak locks were allowed.
-// Returns 0 if success, FL_ERROR if error and FL_ABANDONED if weak locks were blocked.
+// Returns 0 if success, FL_ERROR if error and FL_ABANDONED if weak locks were blocked (or the lock was closed).
 int fair_lock_lock_weak(Fair_Lock *lock);
 // Block all weak locks. Any lock request blocked in the 'fair_lock_lock_weak' function will be interrupted and the function will
 // return FL_ABANDONED, as stated before. Also, new calls to 'fair_lock_lock_weak' will immediately return FL_ABANDONED until
 // 'fair_lock_allow_weak_locks' is called.
 // If weak locks are already blocked, this call does nothing.
+// This call takes O(1), regardless of how many weak lock requests are waiting: the abandoned callers are woken up all at once and
+// leave the queue by themselves.
 void fair_lock_block_weak_locks(Fair_Lock* lock);
+// Closes the lock, to shut down whatever it protects: all callers waiting for the lock, weak or strong, stop waiting and return
+// FL_ABANDONED, and so does any later call that would have to wait for the lock. Callers still get the lock if it is free.
+// The caller holding the lock (if any) keeps it and must unlock it as usual. A closed lock cannot be reopened.
+// This call holds the internal mutex for O(1), regardless of how many callers are waiting. Weak callers are all woken up with a
+// single wake-up, and so are strong ones when using futexes on a kernel with futex_waitv. Otherwise, strong callers are each
+// woken up directly, after the internal mutex is released.
+void fair_lock_close(Fair_Lock* lock);
 // Allow all weak locks. After this call, weak locks are allowed again and behave normally.
 // If weak locks are already allowed, this call does nothing.
 void fair_lock_allow_weak_locks(Fair_Lock* lock);
+// Sets how blocked callers spin before parking. By default, callers park immediately.
+// Must be called after 'fair_lock_init' and before the lock is used.
+void fair_lock_set_spin_policy(Fair_Lock* lock, const Fair_Lock_Spin_Policy* policy);
+// Gets how many blocked callers got the lock while spinning ('*successes') and how many had to park after spinning ('*failures').
+// Callers that did not spin (because the policy disables spinning) are not counted.
+void fair_lock_get_spin_stats(Fair_Lock* lock, unsigned long long* successes, unsigned long long* failures);
+// Gets the highest number of threads that were waiting for the lock at the same time.
+int fair_lock_get_max_waiting_threads(Fair_Lock* lock);
+
+// Auxiliar functions to spin with backoff, following a Fair_Lock_Spin_Policy. Also used by blocking_queue.h.
+static inline void fair_lock_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+static inline unsigned long long fair_lock_now_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long)now.tv_sec * 1000000000ull + (unsigned long long)now.tv_nsec;
+}
+
+static inline void fair_lock_spinner_init(Fair_Lock_Spinner* spinner, const Fair_Lock_Spin_Policy* policy) {
+	spinner->policy = policy;
+	spinner->iterations = 0;
+	spinner->backoff = 1;
+	spinner->deadline_ns = policy->max_ns ? fair_lock_now_ns() + policy->max_ns : 0;
+}
+
+// Initializes 'cond' for 'fair_lock_cond_timedwait': deadlines are then measured in the clock of 'fair_lock_now_ns'.
+// Returns 0 if success, as 'pthread_cond_init'.
+static inline int fair_lock_cond_init(pthread_cond_t* cond) {
+#if defined(__APPLE__)
+	return pthread_cond_init(cond, NULL);
+#else
+	pthread_condattr_t attr;
+	if (pthread_condattr_init(&attr)) {
+		return -1;
+	}
+	int ret = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) || pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+	return ret;
+#endif
+}
+
+// Waits on 'cond' (initialized with 'fair_lock_cond_init') until it is signaled or 'deadline_ns' (see 'fair_lock_now_ns') is
+// reached. A deadline of 0 means no deadline.
+// Returns true if the deadline was reached.
+static inline int fair_lock_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, unsigned long long deadline_ns) {
+	if (deadline_ns == 0) {
+		pthread_cond_wait(cond, mutex);
+		return 0;
+	}
+	struct timespec deadline;
+#if defined(__APPLE__)
+	// The cond measures deadlines in the realtime clock
+	unsigned long long now_ns = fair_lock_now_ns();
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	unsigned long long realtime_deadline_ns = (unsigned long long)deadline.tv_sec * 1000000000ull +
+		(unsigned long long)deadline.tv_nsec + (deadline_ns > now_ns ? deadline_ns - now_ns : 0);
+	deadline.tv_sec = (time_t)(realtime_deadline_ns / 1000000000ull);
+	deadline.tv_nsec = (long)(realtime_deadline_ns % 1000000000ull);
+#else
+	deadline.tv_sec = (time_t)(deadline_ns / 1000000000ull);
+	deadline.tv_nsec = (long)(deadline_ns % 1000000000ull);
+#endif
+	return pthread_cond_timedwait(cond, mutex, &deadline) == ETIMEDOUT;
+}
+
+// Waits a little, doubling the wait on every call (up to a limit).
+// Returns 0 if the spin budget is exhausted, in which case the caller should park.
+static inline int fair_lock_spinner_spin(Fair_Lock_Spinner* spinner) {
+	if (spinner->iterations >= spinner->policy->max_iterations) {
+		return 0;
+	}
+	if (spinner->deadline_ns && fair_lock_now_ns() >= spinner->deadline_ns) {
+		return 0;
+	}
+	++spinner->iterations;
+	for (unsigned int i = 0; i < spinner->backoff; ++i) {
+		fair_lock_cpu_relax();
+	}
+	if (spinner->backoff < 64) {
+		spinner->backoff <<= 1;
+	}
+	return 1;
+}
 
 #ifdef C_FEK_FAIR_LOCK_IMPLEMENTATION
 #if !defined(C_FEK_FAIR_LOCK_NO_CRT)
 #include <stdlib.h>
 #endif
+#if defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#if defined(C_FEK_FAIR_LOCK_USDT)
+#include <sys/sdt.h>
+#define FAIR_LOCK_PROBE2(name, a, b) DTRACE_PROBE2(c_fek_fair_lock, name, a, b)
+#define FAIR_LOCK_PROBE3(name, a, b, c) DTRACE_PROBE3(c_fek_fair_lock, name, a, b, c)
+#else
+#define FAIR_LOCK_PROBE2(name, a, b)
+#define FAIR_LOCK_PROBE3(name, a, b, c)
+#endif
 
-static Cond_Queue_Entry* enqueue_cond_queue_entry(Fair_Lock* lock, int weak) {
-	if (lock->cond_pool == NULL) {
-		Cond_Queue_Entry* new_entry = (Cond_Queue_Entry*)malloc(sizeof(Cond_Queue_Entry));
-		if (new_entry == NULL) {
-			return NULL;
+#define FL_ENTRY_WAITING 0
+#define FL_ENTRY_GRANTED 1
+// Only stored in strong entries, by 'fair_lock_close' when they must be woken up one by one. Otherwise, strong callers find out
+// from 'closed' that they were abandoned, and weak callers from a change of the lock's weak generation.
+#define FL_ENTRY_ABANDONED 2
+// Like FL_ENTRY_WAITING, but the caller is (or is about to be) sleeping in the futex and must be woken up
+#define FL_ENTRY_PARKED 3
+// Never stored in an entry: returned by 'wait_cond_queue_entry' when the caller's deadline was reached
+#define FL_ENTRY_TIMED_OUT 4
+
+// Nobody holds the lock. Implies that there are no callers waiting.
+#define FL_STATE_UNLOCKED 0
+// The lock is held and no caller is waiting for it. It can be unlocked with a CAS.
+#define FL_STATE_LOCKED 1
+// The lock is held and callers may be waiting for it. Only set with 'mutex' held; unlocking must go through the queue.
+#define FL_STATE_CONTENDED 2
+
+#if defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+// Sleeps while '*word' is 'value', until woken up or until 'deadline_ns' (see 'fair_lock_now_ns', 0 means no deadline).
+// Returns true if the deadline was reached.
+static int fair_lock_futex_wait(unsigned int* word, unsigned int value, unsigned int bitset, unsigned long long deadline_ns) {
+	struct timespec deadline;
+	deadline.tv_sec = (time_t)(deadline_ns / 1000000000ull);
+	deadline.tv_nsec = (long)(deadline_ns % 1000000000ull);
+	// FUTEX_WAIT_BITSET takes an absolute deadline, in CLOCK_MONOTONIC
+	return syscall(SYS_futex, word, FUTEX_WAIT_BITSET_PRIVATE, value, deadline_ns ? &deadline : NULL, NULL, bitset) == -1 &&
+		errno == ETIMEDOUT;
+}
+
+static void fair_lock_futex_wake(unsigned int* word, int count, unsigned int bitset) {
+	syscall(SYS_futex, word, FUTEX_WAKE_BITSET_PRIVATE, count, NULL, NULL, bitset);
+}
+
+// Returns true if the kernel supports futex_waitv (Linux 5.16+). Checked once: a wait on zero words fails with EINVAL if it does.
+static int fair_lock_has_futex_waitv(void) {
+#if defined(SYS_futex_waitv)
+	// 0 if not checked yet, 1 if supported, 2 otherwise
+	static int support = 0;
+	int current = __atomic_load_n(&support, __ATOMIC_RELAXED);
+	if (current == 0) {
+		current = syscall(SYS_futex_waitv, NULL, 0, 0, NULL, 0) == -1 && errno == EINVAL ? 1 : 2;
+		__atomic_store_n(&support, current, __ATOMIC_RELAXED);
+	}
+	return current == 1;
+#else
+	return 0;
+#endif
+}
+
+#if defined(SYS_futex_waitv)
+// Like 'fair_lock_futex_wait', but sleeps while both '*word' is 'value' and '*other_word' is 'other_value'. Only used if
+// 'fair_lock_has_futex_waitv' is true.
+static int fair_lock_futex_wait2(unsigned int* word, unsigned int value, unsigned int* other_word, unsigned int other_value,
+	unsigned long long deadline_ns) {
+	struct futex_waitv waiters[2];
+	waiters[0].val = value;
+	waiters[0].uaddr = (unsigned long)word;
+	waiters[0].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+	waiters[0].__reserved = 0;
+	waiters[1].val = other_value;
+	waiters[1].uaddr = (unsigned long)other_word;
+	waiters[1].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+	waiters[1].__reserved = 0;
+	struct timespec deadline;
+	deadline.tv_sec = (time_t)(deadline_ns / 1000000000ull);
+	deadline.tv_nsec = (long)(deadline_ns % 1000000000ull);
+	return syscall(SYS_futex_waitv, waiters, 2, 0, deadline_ns ? &deadline : NULL, CLOCK_MONOTONIC) == -1 && errno == ETIMEDOUT;
+}
+#endif
+#endif
+
+static unsigned int get_weak_channel(const Cond_Queue_Entry* entry) {
+	return (unsigned int)(entry->ticket % FL_WEAK_CHANNELS);
+}
+
+// Sets the state of the entry to 'state' (FL_ENTRY_GRANTED, or FL_ENTRY_ABANDONED for strong entries). The entry was already
+// removed from its queue.
+// Must be called with the internal mutex held, except for strong entries detached by 'fair_lock_close'.
+// Returns true if the caller is parked and must be woken up ('wake_cond_queue_entry' or 'wake_weak_channels').
+static int set_cond_queue_entry_state(Fair_Lock* lock, Cond_Queue_Entry* entry, unsigned int state) {
+#if defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+	// If the caller is still spinning, it will see the new state by itself
+	if (__atomic_exchange_n(&entry->state, state, __ATOMIC_RELEASE) != FL_ENTRY_PARKED) {
+		return 0;
+	}
+	if (entry->weak) {
+		// Parked weak callers sleep on 'weak_futex', so it must change before they are woken up
+		__atomic_add_fetch(&lock->weak_futex, 1, __ATOMIC_RELEASE);
+	}
+	return 1;
+#else
+	(void)lock;
+	__atomic_store_n(&entry->state, state, __ATOMIC_RELEASE);
+	return 1;
+#endif
+}
+
+// Wakes up the strong caller bound to 'entry', whose state was just changed.
+// When using futexes, this may be called after the internal mutex was released: if the entry was already recycled by then,
+// its new owner simply sees a spurious wake-up.
+static void wake_cond_queue_entry(Cond_Queue_Entry* entry) {
+#if defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+	fair_lock_futex_wake(&entry->state, 1, FUTEX_BITSET_MATCH_ANY);
+#else
+	pthread_cond_signal(&entry->cond);
+#endif
+}
+
+// Wakes up all parked weak callers whose channel is set in the 'channels' bit mask. Those that were neither handed over the lock
+// nor abandoned go back to sleep.
+// When using futexes, this may be called after the internal mutex was released.
+static void wake_weak_channels(Fair_Lock* lock, unsigned int channels) {
+#if defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+	fair_lock_futex_wake(&lock->weak_futex, INT_MAX, channels);
+#else
+	for (unsigned int i = 0; i < FL_WEAK_CHANNELS; ++i) {
+		if (channels & (1u << i)) {
+			pthread_cond_broadcast(&lock->weak_conds[i]);
 		}
-		if (pthread_cond_init(&new_entry->cond, NULL)) {
-			free(new_entry);
-			return NULL;
+	}
+#endif
+}
+
+// Gets the state of 'entry' as seen by its caller: FL_ENTRY_WAITING, FL_ENTRY_GRANTED or FL_ENTRY_ABANDONED.
+static unsigned int get_cond_queue_entry_state(Fair_Lock* lock, Cond_Queue_Entry* entry) {
+	if (entry->weak && __atomic_load_n(&lock->weak_generation, __ATOMIC_ACQUIRE) != entry->generation) {
+		// Weak callers can only be handed over the lock before their generation is abandoned, so this state is final
+		return __atomic_load_n(&entry->state, __ATOMIC_ACQUIRE) == FL_ENTRY_GRANTED ? FL_ENTRY_GRANTED : FL_ENTRY_ABANDONED;
+	}
+	unsigned int state = __atomic_load_n(&entry->state, __ATOMIC_ACQUIRE);
+	if (state == FL_ENTRY_GRANTED) {
+		return state;
+	}
+	// Strong callers that were not handed over the lock before it was closed were abandoned, even if 'fair_lock_close' did not
+	// touch their entries
+	if (!entry->weak && __atomic_load_n(&lock->closed, __ATOMIC_ACQUIRE)) {
+		return FL_ENTRY_ABANDONED;
+	}
+	return state == FL_ENTRY_PARKED ? FL_ENTRY_WAITING : state;
+}
+
+// Waits until the caller bound to 'entry' is handed over the lock or abandoned, spinning first if the spin policy allows it.
+// Gives up when 'deadline_ns' is reached (0 means no deadline).
+// Must be called with the internal mutex held. When using futexes, the mutex is released and not reacquired.
+// Returns the new state (FL_ENTRY_GRANTED or FL_ENTRY_ABANDONED), or FL_ENTRY_TIMED_OUT. When using futexes, the state may still
+// change after the caller timed out, so it must be checked again with the mutex held. Otherwise, the caller is still waiting.
+static unsigned int wait_cond_queue_entry(Fair_Lock* lock, Cond_Queue_Entry* entry, unsigned long long deadline_ns) {
+	unsigned int state;
+	if (lock->spin_policy.max_iterations) {
+		pthread_mutex_unlock(&lock->mutex);
+		Fair_Lock_Spinner spinner;
+		fair_lock_spinner_init(&spinner, &lock->spin_policy);
+		while ((state = get_cond_queue_entry_state(lock, entry)) == FL_ENTRY_WAITING) {
+			if (!fair_lock_spinner_spin(&spinner)) {
+				break;
+			}
 		}
-		lock->cond_pool = new_entry;
-		lock->cond_pool->next = NULL;
+		__atomic_add_fetch(state == FL_ENTRY_WAITING ? &lock->spin_failures : &lock->spin_successes, 1, __ATOMIC_RELAXED);
+#if defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+		if (state != FL_ENTRY_WAITING) {
+			return state;
+		}
+#else
+		pthread_mutex_lock(&lock->mutex);
+#endif
 	}
+#if defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+	else {
+		pthread_mutex_unlock(&lock->mutex);
+	}
+	while (1) {
+		unsigned int* word = &entry->state;
+		unsigned int value = FL_ENTRY_PARKED;
+		unsigned int bitset = FUTEX_BITSET_MATCH_ANY;
+		unsigned int close_value = 0;
+		if (entry->weak) {
+			// Weak callers sleep on a word of the lock, so abandoning all of them takes a single wake-up
+			word = &lock->weak_futex;
+			value = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+			bitset = 1u << get_weak_channel(entry);
+		} else if (lock->use_futex_waitv) {
+			// Read before checking 'closed': if the lock is closed after the check, the futex does not put us to sleep
+			close_value = __atomic_load_n(&lock->close_futex, __ATOMIC_SEQ_CST);
+		}
+		state = FL_ENTRY_WAITING;
+		if (!__atomic_compare_exchange_n(&entry->state, &state, FL_ENTRY_PARKED, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE) &&
+			state != FL_ENTRY_PARKED) {
+			return state;
+		}
+		if ((state = get_cond_queue_entry_state(lock, entry)) != FL_ENTRY_WAITING) {
+			return state;
+		}
+#if defined(SYS_futex_waitv)
+		if (!entry->weak && lock->use_futex_waitv) {
+			if (fair_lock_futex_wait2(word, value, &lock->close_futex, close_value, deadline_ns)) {
+				return FL_ENTRY_TIMED_OUT;
+			}
+			continue;
+		}
+#endif
+		(void)close_value;
+		if (fair_lock_futex_wait(word, value, bitset, deadline_ns)) {
+			return FL_ENTRY_TIMED_OUT;
+		}
+	}
+#else
+	pthread_cond_t* cond = entry->weak ? &lock->weak_conds[get_weak_channel(entry)] : &entry->cond;
+	while ((state = get_cond_queue_entry_state(lock, entry)) == FL_ENTRY_WAITING) {
+		if (fair_lock_cond_timedwait(cond, &lock->mutex, deadline_ns)) {
+			state = get_cond_queue_entry_state(lock, entry);
+			return state == FL_ENTRY_WAITING ? FL_ENTRY_TIMED_OUT : state;
+		}
+	}
+	return state;
+#endif
+}
+
+void* fair_lock_allocator_realloc(const Fair_Lock_Allocator* allocator, void* block, size_t old_size, size_t new_size) {
+	if (allocator && allocator->realloc) {
+		return allocator->realloc(allocator->ctx, block, old_size, new_size);
+	}
+	if (allocator == NULL || allocator->alloc == NULL) {
+#if !defined(C_FEK_FAIR_LOCK_NO_CRT)
+		return realloc(block, new_size);
+#else
+		// Without the C Runtime Library, only malloc/free are available
+		void* new_block = malloc(new_size);
+		if (new_block) {
+			__builtin_memcpy(new_block, block, old_size < new_size ? old_size : new_size);
+			free(block);
+		}
+		return new_block;
+#endif
+	}
+	void* new_block = allocator->alloc(allocator->ctx, new_size);
+	if (new_block) {
+		__builtin_memcpy(new_block, block, old_size < new_size ? old_size : new_size);
+		allocator->free(allocator->ctx, block, old_size);
+	}
+	return new_block;
+}
+
+static void* fair_lock_alloc(Fair_Lock* lock, size_t size) {
+	if (lock->allocator.alloc) {
+		return lock->allocator.alloc(lock->allocator.ctx, size);
+	}
+	return malloc(size);
+}
 
-	lock->cond_pool->weak = weak;
-	lock->cond_pool->abandoned = 0;
-	if (lock->cond_queue_front != NULL) {
-		lock->cond_queue_rear->next = lock->cond_pool;
-		lock->cond_queue_rear = lock->cond_pool;
+static void fair_lock_free(Fair_Lock* lock, void* block, size_t size) {
+	if (lock->allocator.free) {
+		lock->allocator.free(lock->allocator.ctx, block, size);
 	} else {
-		lock->cond_queue_front = lock->cond_pool;
-		lock->cond_queue_rear = lock->cond_pool;
+		free(block);
 	}
-	
-	lock->cond_pool = lock->cond_pool->next;
-	lock->cond_queue_rear->next = NULL;
+}
 
-	return lock->cond_queue_rear;
+// Allocates a new Cond_Queue_Entry and adds it to the pool.
+// Returns 0 if success, FL_ERROR otherwise.
+static int grow_cond_pool(Fair_Lock* lock) {
+	Cond_Queue_Entry* new_entry = (Cond_Queue_Entry*)fair_lock_alloc(lock, sizeof(Cond_Queue_Entry));
+	if (new_entry == NULL) {
+		return FL_ERROR;
+	}
+#if !defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+	if (fair_lock_cond_init(&new_entry->cond)) {
+		fair_lock_free(lock, new_entry, sizeof(Cond_Queue_Entry));
+		return FL_ERROR;
+	}
+#endif
+	new_entry->next = lock->cond_pool;
+	lock->cond_pool = new_entry;
+	return 0;
 }
 
-static Cond_Queue_Entry* dequeue_cond_queue_entry(Fair_Lock* lock) {
-	if (lock->cond_queue_front == NULL) {
+static Cond_Queue_Entry* enqueue_cond_queue_entry(Fair_Lock* lock, int weak) {
+	if (lock->cond_pool == NULL && grow_cond_pool(lock)) {
 		return NULL;
 	}
 
-	Cond_Queue_Entry* target = lock->cond_queue_front;
+	Cond_Queue_Entry* entry = lock->cond_pool;
+	lock->cond_pool = entry->next;
+	entry->weak = weak;
+	entry->state = FL_ENTRY_WAITING;
+	entry->ticket = lock->next_ticket++;
+	entry->generation = lock->weak_generation;
+	entry->next = NULL;
 
-	if (target == lock->cond_queue_rear) {
-		//assert(target->next == NULL);
-		lock->cond_queue_rear = NULL;
+	Cond_Queue* queue = weak ? &lock->weak_queue : &lock->strong_queue;
+	entry->prev = queue->rear;
+	if (queue->front != NULL) {
+		queue->rear->next = entry;
+	} else {
+		queue->front = entry;
+	}
+	queue->rear = entry;
+	if (weak) {
+		++lock->weak_waiting_threads;
 	}
 
-	lock->cond_queue_front = target->next;
+	return entry;
+}
+
+// Removes the caller that has been waiting for the longest time, weak or strong
+static Cond_Queue_Entry* dequeue_cond_queue_entry(Fair_Lock* lock) {
+	Cond_Queue* queue = &lock->strong_queue;
+	if (lock->weak_queue.front != NULL &&
+		(queue->front == NULL || lock->weak_queue.front->ticket < queue->front->ticket)) {
+		queue = &lock->weak_queue;
+		--lock->weak_waiting_threads;
+	}
+
+	Cond_Queue_Entry* target = queue->front;
+	if (target == NULL) {
+		return NULL;
+	}
+
+	queue->front = target->next;
+	if (queue->front == NULL) {
+		queue->rear = NULL;
+	} else {
+		queue->front->prev = NULL;
+	}
 
 	return target;
 }
 
+// Removes the caller bound to 'entry', which is still waiting, from the middle of its queue. The callers behind it keep their
+// order. Must be called with the internal mutex held.
+static void remove_cond_queue_entry(Fair_Lock* lock, Cond_Queue_Entry* entry) {
+	Cond_Queue* queue = entry->weak ? &lock->weak_queue : &lock->strong_queue;
+	if (entry->prev != NULL) {
+		entry->prev->next = entry->next;
+	} else {
+		queue->front = entry->next;
+	}
+	if (entry->next != NULL) {
+		entry->next->prev = entry->prev;
+	} else {
+		queue->rear = entry->prev;
+	}
+	if (entry->weak) {
+		--lock->weak_waiting_threads;
+	}
+	--lock->waiting_threads;
+}
+
 static void release_cond_queue_entry(Fair_Lock* lock, Cond_Queue_Entry* entry) {
 	entry->next = lock->cond_pool;
 	lock->cond_pool = entry;
 }
 
-static void abandone_weak_locks(Fair_Lock* lock) {
-	Cond_Queue_Entry* current_entry = lock->cond_queue_front;
-	Cond_Queue_Entry* first_strong_entry = NULL;
-	Cond_Queue_Entry* last_strong_entry = NULL;
-	while (current_entry) {
-		if (current_entry->weak) {
-			if (last_strong_entry != NULL) {
-				last_strong_entry->next = current_entry->next;
-			}
-			current_entry->abandoned = 1;
-			--lock->waiting_threads;
-			pthread_cond_signal(&current_entry->cond);
-		} else {
-			if (first_strong_entry == NULL) {
-				first_strong_entry = current_entry;
-			}
-			last_strong_entry = current_entry;
-		}
-		current_entry = current_entry->next;
+// Abandons all weak callers in O(1): the weak queue is dropped as a whole and its callers find out by themselves that their
+// generation was abandoned (see 'get_cond_queue_entry_state'). Each one gives its entry back to the pool.
+// Must be called with the internal mutex held.
+// Returns true if weak callers must be woken up with 'wake_weak_channels'.
+static int abandone_weak_locks(Fair_Lock* lock) {
+	int abandoned_count = lock->weak_waiting_threads;
+	FAIR_LOCK_PROBE2(abandon__weak, lock, abandoned_count);
+	if (abandoned_count == 0) {
+		return 0;
 	}
-	lock->cond_queue_front = first_strong_entry;
-	lock->cond_queue_rear = last_strong_entry;
+	lock->weak_queue.front = NULL;
+	lock->weak_queue.rear = NULL;
+	lock->weak_waiting_threads = 0;
+	lock->waiting_threads -= abandoned_count;
+	__atomic_add_fetch(&lock->weak_generation, 1, __ATOMIC_RELEASE);
+#if defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+	__atomic_add_fetch(&lock->weak_futex, 1, __ATOMIC_RELEASE);
+#endif
+	return 1;
 }
 
 int fair_lock_init(Fair_Lock* lock) {
+	return fair_lock_init_with_allocator(lock, NULL);
+}
+
+int fair_lock_init_with_allocator(Fair_Lock* lock, const Fair_Lock_Allocator* allocator) {
+	return fair_lock_init_with_capacity(lock, 0, allocator);
+}
+
+int fair_lock_init_with_capacity(Fair_Lock* lock, unsigned int capacity, const Fair_Lock_Allocator* allocator) {
+	if (allocator && !allocator->alloc != !allocator->free) {
+		return FL_ERROR;
+	}
+
 	if (pthread_mutex_init(&lock->mutex, NULL)) {
 		return FL_ERROR;
 	}
+#if !defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+	for (unsigned int i = 0; i < FL_WEAK_CHANNELS; ++i) {
+		if (fair_lock_cond_init(&lock->weak_conds[i])) {
+			while (i--) {
+				pthread_cond_destroy(&lock->weak_conds[i]);
+			}
+			pthread_mutex_destroy(&lock->mutex);
+			return FL_ERROR;
+		}
+	}
+#else
+	lock->weak_futex = 0;
+	lock->close_futex = 0;
+	lock->use_futex_waitv = fair_lock_has_futex_waitv();
+#endif
 
 	lock->cond_pool = NULL;
-	lock->cond_queue_front = NULL;
-	lock->cond_queue_rear = NULL;
-	lock->is_lock_acquired = 0;
+	lock->owner_entry = NULL;
+	lock->strong_queue.front = NULL;
+	lock->strong_queue.rear = NULL;
+	lock->weak_queue.front = NULL;
+	lock->weak_queue.rear = NULL;
+	lock->next_ticket = 0;
+	lock->state = FL_STATE_UNLOCKED;
 	lock->waiting_threads = 0;
+	lock->max_waiting_threads = 0;
+	lock->weak_waiting_threads = 0;
+	lock->weak_generation = 0;
 	lock->block_weak_locks = 0;
+	lock->closed = 0;
+	lock->spin_policy.max_iterations = 0;
+	lock->spin_policy.max_ns = 0;
+	lock->spin_successes = 0;
+	lock->spin_failures = 0;
+	lock->allocator.alloc = NULL;
+	lock->allocator.realloc = NULL;
+	lock->allocator.free = NULL;
+	lock->allocator.ctx = NULL;
+	if (allocator) {
+		lock->allocator = *allocator;
+	}
+
+	for (unsigned int i = 0; i < capacity; ++i) {
+		if (grow_cond_pool(lock)) {
+			fair_lock_destroy(lock);
+			return FL_ERROR;
+		}
+	}
 
 	return 0;
 }
 
 void fair_lock_destroy(Fair_Lock* lock) {
-	//assert(lock->cond_queue_front == NULL);
+	//assert(lock->strong_queue.front == NULL && lock->weak_queue.front == NULL);
+	if (lock->owner_entry != NULL) {
+		release_cond_queue_entry(lock, lock->owner_entry);
+	}
 	Cond_Queue_Entry* entry = lock->cond_pool;
 	while (entry) {
 		Cond_Queue_Entry* next = entry->next;
 		//assert(!pthread_cond_destroy(&entry->cond));
-		free(entry);
+		fair_lock_free(lock, entry, sizeof(Cond_Queue_Entry));
 		entry = next;
 	}
+#if !defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+	for (unsigned int i = 0; i < FL_WEAK_CHANNELS; ++i) {
+		pthread_cond_destroy(&lock->weak_conds[i]);
+	}
+#endif
 	pthread_mutex_destroy(&lock->mutex);
 }
 
-static int _fair_lock_lock(Fair_Lock *lock, int weak) {
+static int _fair_lock_lock(Fair_Lock *lock, int weak, unsigned long long deadline_ns) {
+	// Fast path: the lock is free, so nobody is waiting for it
+	unsigned int state = FL_STATE_UNLOCKED;
+	if (!(weak && __atomic_load_n(&lock->block_weak_locks, __ATOMIC_RELAXED)) &&
+		__atomic_compare_exchange_n(&lock->state, &state, FL_STATE_LOCKED, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		return 0;
+	}
+
 	pthread_mutex_lock(&lock->mutex);
-	if (weak && lock->block_weak_locks) {
+	if (lock->closed || (weak && lock->block_weak_locks)) {
 		pthread_mutex_unlock(&lock->mutex);
 		return FL_ABANDONED;
 	}
-	if (lock->is_lock_acquired || lock->waiting_threads > 0) {
-		++lock->waiting_threads;
-		Cond_Queue_Entry* entry = enqueue_cond_queue_entry(lock, weak);
-		if (entry == NULL) {
-			--lock->waiting_threads;
-			pthread_mutex_unlock(&lock->mutex);
-			return FL_ERROR;
+
+	// Mark the lock as contended before queueing, so the holder does not use the fast unlock.
+	// If the lock was released in the meantime, just take it.
+	state = __atomic_load_n(&lock->state, __ATOMIC_RELAXED);
+	while (state != FL_STATE_CONTENDED) {
+		unsigned int desired = state == FL_STATE_UNLOCKED ? FL_STATE_LOCKED : FL_STATE_CONTENDED;
+		if (__atomic_compare_exchange_n(&lock->state, &state, desired, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			if (desired == FL_STATE_LOCKED) {
+				pthread_mutex_unlock(&lock->mutex);
+				return 0;
+			}
+			break;
 		}
-		pthread_cond_wait(&entry->cond, &lock->mutex);
+	}
+
+	++lock->waiting_threads;
+	if (lock->waiting_threads > lock->max_waiting_threads) {
+		__atomic_store_n(&lock->max_waiting_threads, lock->waiting_threads, __ATOMIC_RELAXED);
+	}
+	Cond_Queue_Entry* entry = enqueue_cond_queue_entry(lock, weak);
+	if (entry == NULL) {
+		--lock->waiting_threads;
+		pthread_mutex_unlock(&lock->mutex);
+		return FL_ERROR;
+	}
+	FAIR_LOCK_PROBE3(wait__begin, lock, weak, lock->waiting_threads);
+	unsigned int entry_state = wait_cond_queue_entry(lock, entry, deadline_ns);
+#if defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+	if (entry_state == FL_ENTRY_GRANTED) {
+		FAIR_LOCK_PROBE2(wait__end, lock, 0);
+		// The lock was handed over to us by 'fair_lock_unlock' (it never became free in between)
+		return 0;
+	}
+	if (entry_state == FL_ENTRY_ABANDONED && !entry->weak) {
+		// Abandoned by 'fair_lock_close', which gives the entry back to the pool: no need for the mutex
+		FAIR_LOCK_PROBE2(wait__end, lock, FL_ABANDONED);
+		return FL_ABANDONED;
+	}
+	pthread_mutex_lock(&lock->mutex);
+	if (entry_state == FL_ENTRY_TIMED_OUT) {
+		// The lock may have been handed over to us (or we may have been abandoned) before we got the mutex
+		entry_state = get_cond_queue_entry_state(lock, entry);
+		if (entry_state == FL_ENTRY_WAITING) {
+			entry_state = FL_ENTRY_TIMED_OUT;
+		}
+	}
+#endif
+	int ret = 0;
+	if (entry_state == FL_ENTRY_TIMED_OUT) {
+		remove_cond_queue_entry(lock, entry);
 		release_cond_queue_entry(lock, entry);
-		if (entry->abandoned) {
-			//assert(weak);
-			pthread_mutex_unlock(&lock->mutex);
-			return FL_ABANDONED;
+		ret = FL_TIMEOUT;
+	} else if (entry_state == FL_ENTRY_ABANDONED) {
+		// Strong entries are only abandoned by 'fair_lock_close', which gives them back to the pool itself
+		if (entry->weak) {
+			release_cond_queue_entry(lock, entry);
 		}
-		--lock->waiting_threads;
+		ret = FL_ABANDONED;
 	}
-	//assert(lock->is_lock_acquired == 0);
-	lock->is_lock_acquired = 1;
 	pthread_mutex_unlock(&lock->mutex);
-	return 0;
+	FAIR_LOCK_PROBE2(wait__end, lock, ret);
+	return ret;
 }
 
 int fair_lock_lock(Fair_Lock *lock) {
-	return _fair_lock_lock(lock, 0);
+	return _fair_lock_lock(lock, 0, 0);
+}
+
+int fair_lock_lock_timed(Fair_Lock *lock, unsigned long long deadline_ns) {
+	return _fair_lock_lock(lock, 0, deadline_ns);
 }
 
 int fair_lock_lock_weak(Fair_Lock *lock) {
-	return _fair_lock_lock(lock, 1);
+	return _fair_lock_lock(lock, 1, 0);
 }
 
 void fair_lock_unlock(Fair_Lock *lock)
 {
+	// Fast path: nobody is waiting for the lock
+	unsigned int state = FL_STATE_LOCKED;
+	if (__atomic_compare_exchange_n(&lock->state, &state, FL_STATE_UNLOCKED, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+		return;
+	}
+
 	pthread_mutex_lock(&lock->mutex);
-	//assert(lock->is_lock_acquired);
+	//assert(lock->state == FL_STATE_CONTENDED);
+	if (lock->owner_entry != NULL) {
+		release_cond_queue_entry(lock, lock->owner_entry);
+		lock->owner_entry = NULL;
+	}
 	Cond_Queue_Entry* entry = dequeue_cond_queue_entry(lock);
+	int must_wake = 0;
+	// Channel to wake up if the new owner is a weak caller. The entry may be recycled once the mutex is released.
+	unsigned int weak_channels = 0;
 	if (entry != NULL) {
-		//assert(entry->abandoned == 0);
-		pthread_cond_signal(&entry->cond);
+		//assert(entry->state == FL_ENTRY_WAITING || entry->state == FL_ENTRY_PARKED);
+		// Direct handoff: the lock stays acquired and now belongs to the caller bound to 'entry'
+		--lock->waiting_threads;
+		lock->owner_entry = entry;
+		if (lock->strong_queue.front == NULL && lock->weak_queue.front == NULL) {
+			// The new owner may use the fast unlock
+			__atomic_store_n(&lock->state, FL_STATE_LOCKED, __ATOMIC_RELAXED);
+		}
+		must_wake = set_cond_queue_entry_state(lock, entry, FL_ENTRY_GRANTED);
+		if (entry->weak) {
+			weak_channels = 1u << get_weak_channel(entry);
+		}
+#if !defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+		if (must_wake) {
+			if (weak_channels) {
+				wake_weak_channels(lock, weak_channels);
+			} else {
+				wake_cond_queue_entry(entry);
+			}
+		}
+#endif
+	} else {
+		// All waiters gave up (weak locks that were abandoned)
+		__atomic_store_n(&lock->state, FL_STATE_UNLOCKED, __ATOMIC_RELEASE);
 	}
-	
-	lock->is_lock_acquired = 0;
 	pthread_mutex_unlock(&lock->mutex);
+#if defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+	if (must_wake) {
+		if (weak_channels) {
+			wake_weak_channels(lock, weak_channels);
+		} else {
+			wake_cond_queue_entry(entry);
+		}
+	}
+#endif
 }
 
 void fair_lock_block_weak_locks(Fair_Lock* lock)
 {
 	pthread_mutex_lock(&lock->mutex);
-	lock->block_weak_locks = 1;
-	abandone_weak_locks(lock);
+	__atomic_store_n(&lock->block_weak_locks, 1, __ATOMIC_RELAXED);
+	int must_wake = abandone_weak_locks(lock);
+	pthread_mutex_unlock(&lock->mutex);
+	if (must_wake) {
+		// A single wake-up for all of them, after releasing the mutex they need to give their entries back
+		wake_weak_channels(lock, 0xFFFFFFFFu);
+	}
+}
+
+void fair_lock_close(Fair_Lock* lock)
+{
+	pthread_mutex_lock(&lock->mutex);
+	__atomic_store_n(&lock->closed, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&lock->block_weak_locks, 1, __ATOMIC_RELAXED);
+	int must_wake_weak = abandone_weak_locks(lock);
+	// Strong callers are all abandoned at once, without handing the lock over to each of them in turn: they find out by themselves
+	// that the lock was closed (see 'get_cond_queue_entry_state'), so their queue is given back to the pool as a whole. Abandoned
+	// callers leave without touching their entries again, and a closed lock never hands them out again.
+	Cond_Queue_Entry* abandoned = lock->strong_queue.front;
+	Cond_Queue_Entry* last_abandoned = lock->strong_queue.rear;
+	lock->strong_queue.front = NULL;
+	lock->strong_queue.rear = NULL;
+	// Only strong callers were still waiting
+	lock->waiting_threads = 0;
+	if (abandoned != NULL) {
+		last_abandoned->next = lock->cond_pool;
+		lock->cond_pool = abandoned;
+	}
+#if defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+	__atomic_add_fetch(&lock->close_futex, 1, __ATOMIC_SEQ_CST);
+#endif
 	pthread_mutex_unlock(&lock->mutex);
+
+	if (must_wake_weak) {
+		wake_weak_channels(lock, 0xFFFFFFFFu);
+	}
+	if (abandoned == NULL) {
+		return;
+	}
+#if defined(C_FEK_FAIR_LOCK_USE_FUTEX)
+	if (lock->use_futex_waitv) {
+		// Parked strong callers also sleep on 'close_futex': a single wake-up for all of them
+		fair_lock_futex_wake(&lock->close_futex, INT_MAX, FUTEX_BITSET_MATCH_ANY);
+		return;
+	}
+#endif
+	// Otherwise, each one sleeps on its own entry
+	for (Cond_Queue_Entry* entry = abandoned; ; entry = entry->next) {
+		if (set_cond_queue_entry_state(lock, entry, FL_ENTRY_ABANDONED)) {
+			wake_cond_queue_entry(entry);
+		}
+		if (entry == last_abandoned) {
+			break;
+		}
+	}
 }
 
 void fair_lock_allow_weak_locks(Fair_Lock* lock)
 {
 	pthread_mutex_lock(&lock->mutex);
-	lock->block_weak_locks = 0;
+	__atomic_store_n(&lock->block_weak_locks, 0, __ATOMIC_RELAXED);
 	pthread_mutex_unlock(&lock->mutex);
 }
 
+void fair_lock_set_spin_policy(Fair_Lock* lock, const Fair_Lock_Spin_Policy* policy)
+{
+	lock->spin_policy = *policy;
+}
+
+void fair_lock_get_spin_stats(Fair_Lock* lock, unsigned long long* successes, unsigned long long* failures)
+{
+	*successes = __atomic_load_n(&lock->spin_successes, __ATOMIC_RELAXED);
+	*failures = __atomic_load_n(&lock->spin_failures, __ATOMIC_RELAXED);
+}
+
+int fair_lock_get_max_waiting_threads(Fair_Lock* lock)
+{
+	return __atomic_load_n(&lock->max_waiting_threads, __ATOMIC_RELAXED);
+}
+
 #endif
 #endif
@@ -0,0 +1,355 @@
+#ifndef C_FEK_MPMC_BLOCKING_QUEUE
+#define C_FEK_MPMC_BLOCKING_QUEUE
+
+/*
+	Author: Felipe Einsfeld Kersting
+
+	MIT License
+
+	Copyright (c) 2020 Felipe Kersting
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+
+	To use this blocking queue, define C_FEK_MPMC_BLOCKING_QUEUE_IMPLEMENTATION before including mpmc_blocking_queue.h in one of your
+	source files.
+
+	To use this blocking queue, you must link your binary with pthread.
+
+	This is a multi-producer/multi-consumer (MPMC) variant of the blocking queue in blocking_queue.h that does NOT serve blocked
+	callers in FIFO order. Elements still leave the queue in FIFO order, but there are no fair locks: a caller blocked for a long
+	time may be overtaken by callers that arrived later. Use it when throughput matters more than fairness among callers.
+
+	Elements are exchanged through a bounded ring in which every cell carries a sequence number (Dmitry Vyukov's bounded MPMC queue).
+	Producers and consumers claim positions with a CAS and never take a lock in the non-blocking _add/_poll calls. The mutex and the
+	conds are only used by _put/_take to park when the ring is full/empty, and to wake parked callers up.
+
+	This blocking queue has the following properties/features:
+
+	- It has a fixed capacity, provided by the caller. The capacity is rounded up to the next power of two.
+	- It allows the caller to add elements to the queue via both a blocking call and a non-blocking call.
+	- It allows the caller to get elements from the queue via both a blocking call and a non-blocking call.
+
+	Unlike blocking_queue.h, there is no boundless mode.
+
+	Define C_FEK_MPMC_BLOCKING_QUEUE_NO_CRT if you don't want the C Runtime Library included. If this is defined, you must provide
+	implementations for the following functions:
+
+	void* malloc(unsigned int size)
+	void  free(void* block)
+
+	Define C_FEK_MPMC_BLOCKING_QUEUE_CACHE_LINE_SIZE to change the cache line size used to separate the producer and consumer
+	positions (defaults to 64).
+
+	For more information about the API, check the comments in the function signatures.
+
+	https://github.com/felipeek/c-fifo-blocking-queue
+*/
+
+#include "blocking_queue.h"
+
+#ifndef C_FEK_MPMC_BLOCKING_QUEUE_CACHE_LINE_SIZE
+#define C_FEK_MPMC_BLOCKING_QUEUE_CACHE_LINE_SIZE 64
+#endif
+
+// This structure is reserved for internal-use only
+typedef struct {
+	// When equal to the position being written, the cell is free. When equal to the position being read + 1, the cell is full.
+	unsigned int sequence;
+	void* element;
+} Mpmc_Blocking_Queue_Cell;
+
+// This structure is reserved for internal-use only
+typedef struct {
+	// Next position to be claimed by a producer
+	unsigned int enqueue_pos __attribute__((aligned(C_FEK_MPMC_BLOCKING_QUEUE_CACHE_LINE_SIZE)));
+	// Next position to be claimed by a consumer
+	unsigned int dequeue_pos __attribute__((aligned(C_FEK_MPMC_BLOCKING_QUEUE_CACHE_LINE_SIZE)));
+	// The ring of cells. Its capacity is always a power of two.
+	Mpmc_Blocking_Queue_Cell* cells __attribute__((aligned(C_FEK_MPMC_BLOCKING_QUEUE_CACHE_LINE_SIZE)));
+	// The capacity of the ring
+	unsigned int queue_capacity;
+	// queue_capacity - 1
+	unsigned int queue_mask;
+	// Indicates whether the queue was closed.
+	int closed;
+	// Number of producers parked (or about to park) waiting for space
+	int producers_waiting;
+	// Number of consumers parked (or about to park) waiting for an element
+	int consumers_waiting;
+	// Mutex protecting the slow path
+	pthread_mutex_t mutex;
+	// Cond used to wake up consumers
+	pthread_cond_t not_empty_cond;
+	// Cond used to wake up producers
+	pthread_cond_t not_full_cond;
+	// Cond used to wait for parked callers to leave when the queue is closed
+	pthread_cond_t close_cond;
+} Mpmc_Blocking_Queue;
+
+// Init the MPMC blocking queue.
+// The capacity is given by 'capacity', which is rounded up to the next power of two. It must be > 0.
+// Returns 0 if success, -1 if error.
+int mpmc_blocking_queue_init(Mpmc_Blocking_Queue* bq, unsigned int capacity);
+// Adds an element to the queue
+// This function does NOT block the caller and never takes a lock (unless a consumer is parked and must be woken up).
+// Returns:
+// * 0 if success
+// * BQ_FULL if the there is no space in the queue
+// * BQ_CLOSED if the queue was closed
+int mpmc_blocking_queue_add(Mpmc_Blocking_Queue* bq, void* element);
+// Puts an element to the queue
+// If the queue is full, the caller is blocked until there is space in the queue for the new element.
+// Blocked callers are NOT served in FIFO order.
+// Returns:
+// * 0 if success
+// * BQ_CLOSED if the queue was closed while the call was blocked
+int mpmc_blocking_queue_put(Mpmc_Blocking_Queue* bq, void* element);
+// Poll an element from the queue
+// The element is stored in '*element'
+// This function does NOT block the caller and never takes a lock (unless a producer is parked and must be woken up).
+// Returns:
+// * 0 if success
+// * BQ_EMPTY if the queue is empty
+// * BQ_CLOSED if the queue was closed
+int mpmc_blocking_queue_poll(Mpmc_Blocking_Queue* bq, void* element);
+// Take an element from the queue
+// The element is stored in '*element'
+// If the queue is empty, the caller is blocked until there is an element available to take.
+// Blocked callers are NOT served in FIFO order.
+// Returns:
+// * 0 if success
+// * BQ_CLOSED if the queue was closed while the call was blocked
+int mpmc_blocking_queue_take(Mpmc_Blocking_Queue* bq, void* element);
+// Closes the queue.
+// When the queue is closed, all _add/_put/_poll/_take calls will immediately return BQ_CLOSED if called.
+// Callers blocked in one of these calls are unblocked and receive BQ_CLOSED before this function returns.
+// Calling this function multiple times is allowed.
+void mpmc_blocking_queue_close(Mpmc_Blocking_Queue* bq);
+// Destroys the queue, closing it first if needed.
+// Unlike 'blocking_queue_destroy', this function does not track callers that are not blocked, so it must only be called once
+// all callers are done calling the queue (e.g. after they received BQ_CLOSED and were joined).
+void mpmc_blocking_queue_destroy(Mpmc_Blocking_Queue* bq);
+
+#ifdef C_FEK_MPMC_BLOCKING_QUEUE_IMPLEMENTATION
+#if !defined(C_FEK_MPMC_BLOCKING_QUEUE_NO_CRT)
+#include <stdlib.h>
+#endif
+
+int mpmc_blocking_queue_init(Mpmc_Blocking_Queue* bq, unsigned int capacity) {
+	if (capacity == 0 || capacity > 0x40000000u) {
+		return -1;
+	}
+
+	if (pthread_mutex_init(&bq->mutex, NULL)) {
+		return -1;
+	}
+
+	if (pthread_cond_init(&bq->not_empty_cond, NULL)) {
+		pthread_mutex_destroy(&bq->mutex);
+		return -1;
+	}
+
+	if (pthread_cond_init(&bq->not_full_cond, NULL)) {
+		pthread_mutex_destroy(&bq->mutex);
+		pthread_cond_destroy(&bq->not_empty_cond);
+		return -1;
+	}
+
+	if (pthread_cond_init(&bq->close_cond, NULL)) {
+		pthread_mutex_destroy(&bq->mutex);
+		pthread_cond_destroy(&bq->not_empty_cond);
+		pthread_cond_destroy(&bq->not_full_cond);
+		return -1;
+	}
+
+	bq->queue_capacity = 1;
+	while (bq->queue_capacity < capacity) {
+		bq->queue_capacity <<= 1;
+	}
+	bq->queue_mask = bq->queue_capacity - 1;
+	bq->enqueue_pos = 0;
+	bq->dequeue_pos = 0;
+	bq->closed = 0;
+	bq->producers_waiting = 0;
+	bq->consumers_waiting = 0;
+	bq->cells = (Mpmc_Blocking_Queue_Cell*)malloc(bq->queue_capacity * sizeof(Mpmc_Blocking_Queue_Cell));
+	if (bq->cells == NULL) {
+		pthread_mutex_destroy(&bq->mutex);
+		pthread_cond_destroy(&bq->not_empty_cond);
+		pthread_cond_destroy(&bq->not_full_cond);
+		pthread_cond_destroy(&bq->close_cond);
+		return -1;
+	}
+	for (unsigned int i = 0; i < bq->queue_capacity; ++i) {
+		bq->cells[i].sequence = i;
+	}
+
+	return 0;
+}
+
+void mpmc_blocking_queue_close(Mpmc_Blocking_Queue* bq) {
+	pthread_mutex_lock(&bq->mutex);
+	__atomic_store_n(&bq->closed, 1, __ATOMIC_SEQ_CST);
+	pthread_cond_broadcast(&bq->not_empty_cond);
+	pthread_cond_broadcast(&bq->not_full_cond);
+	while (bq->producers_waiting || bq->consumers_waiting) {
+		pthread_cond_wait(&bq->close_cond, &bq->mutex);
+	}
+	pthread_mutex_unlock(&bq->mutex);
+}
+
+void mpmc_blocking_queue_destroy(Mpmc_Blocking_Queue* bq) {
+	mpmc_blocking_queue_close(bq);
+	free(bq->cells);
+	pthread_cond_destroy(&bq->not_empty_cond);
+	pthread_cond_destroy(&bq->not_full_cond);
+	pthread_cond_destroy(&bq->close_cond);
+	pthread_mutex_destroy(&bq->mutex);
+}
+
+static int mpmc_try_enqueue(Mpmc_Blocking_Queue* bq, void* element) {
+	unsigned int pos = __atomic_load_n(&bq->enqueue_pos, __ATOMIC_RELAXED);
+	Mpmc_Blocking_Queue_Cell* cell;
+	while (1) {
+		cell = &bq->cells[pos & bq->queue_mask];
+		unsigned int sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+		int diff = (int)(sequence - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&bq->enqueue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return BQ_FULL;
+		} else {
+			pos = __atomic_load_n(&bq->enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+	cell->element = element;
+	__atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static int mpmc_try_dequeue(Mpmc_Blocking_Queue* bq, void* element) {
+	unsigned int pos = __atomic_load_n(&bq->dequeue_pos, __ATOMIC_RELAXED);
+	Mpmc_Blocking_Queue_Cell* cell;
+	while (1) {
+		cell = &bq->cells[pos & bq->queue_mask];
+		unsigned int sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+		int diff = (int)(sequence - (pos + 1));
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&bq->dequeue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return BQ_EMPTY;
+		} else {
+			pos = __atomic_load_n(&bq->dequeue_pos, __ATOMIC_RELAXED);
+		}
+	}
+	*(void**)element = cell->element;
+	__atomic_store_n(&cell->sequence, pos + bq->queue_mask + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+// Wakes up one caller parked on 'cond', if there is any.
+// The seq_cst fence pairs with the one in 'mpmc_blocking_queue_wait': either the parked caller sees the cell that was just
+// published, or we see its 'waiting' counter.
+static void mpmc_wake(Mpmc_Blocking_Queue* bq, int* waiting, pthread_cond_t* cond) {
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(waiting, __ATOMIC_RELAXED)) {
+		pthread_mutex_lock(&bq->mutex);
+		pthread_cond_signal(cond);
+		pthread_mutex_unlock(&bq->mutex);
+	}
+}
+
+// Retries 'try_op' under the mutex, parking the caller on 'cond' until it succeeds or the queue is closed.
+static int mpmc_blocking_queue_wait(Mpmc_Blocking_Queue* bq, int (*try_op)(Mpmc_Blocking_Queue*, void*), void* arg,
+	int* waiting, pthread_cond_t* cond) {
+	int ret;
+	pthread_mutex_lock(&bq->mutex);
+	__atomic_add_fetch(waiting, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	while (1) {
+		if (__atomic_load_n(&bq->closed, __ATOMIC_RELAXED)) {
+			ret = BQ_CLOSED;
+			break;
+		}
+		ret = try_op(bq, arg);
+		if (ret == 0) {
+			break;
+		}
+		pthread_cond_wait(cond, &bq->mutex);
+	}
+	__atomic_sub_fetch(waiting, 1, __ATOMIC_RELAXED);
+	if (ret == BQ_CLOSED) {
+		pthread_cond_signal(&bq->close_cond);
+	}
+	pthread_mutex_unlock(&bq->mutex);
+	return ret;
+}
+
+static int mpmc_blocking_queue_add_internal(Mpmc_Blocking_Queue* bq, void* element, int async) {
+	if (__atomic_load_n(&bq->closed, __ATOMIC_RELAXED)) {
+		return BQ_CLOSED;
+	}
+
+	int ret = mpmc_try_enqueue(bq, element);
+	if (ret == BQ_FULL && !async) {
+		ret = mpmc_blocking_queue_wait(bq, mpmc_try_enqueue, element, &bq->producers_waiting, &bq->not_full_cond);
+	}
+	if (ret == 0) {
+		mpmc_wake(bq, &bq->consumers_waiting, &bq->not_empty_cond);
+	}
+	return ret;
+}
+
+static int mpmc_blocking_queue_get_internal(Mpmc_Blocking_Queue* bq, void* element, int async) {
+	if (__atomic_load_n(&bq->closed, __ATOMIC_RELAXED)) {
+		return BQ_CLOSED;
+	}
+
+	int ret = mpmc_try_dequeue(bq, element);
+	if (ret == BQ_EMPTY && !async) {
+		ret = mpmc_blocking_queue_wait(bq, mpmc_try_dequeue, element, &bq->consumers_waiting, &bq->not_empty_cond);
+	}
+	if (ret == 0) {
+		mpmc_wake(bq, &bq->producers_waiting, &bq->not_full_cond);
+	}
+	return ret;
+}
+
+int mpmc_blocking_queue_add(Mpmc_Blocking_Queue* bq, void* element) {
+	return mpmc_blocking_queue_add_internal(bq, element, 1);
+}
+
+int mpmc_blocking_queue_put(Mpmc_Blocking_Queue* bq, void* element) {
+	return mpmc_blocking_queue_add_internal(bq, element, 0);
+}
+
+int mpmc_blocking_queue_poll(Mpmc_Blocking_Queue* bq, void* element) {
+	return mpmc_blocking_queue_get_internal(bq, element, 1);
+}
+
+int mpmc_blocking_queue_take(Mpmc_Blocking_Queue* bq, void* element) {
+	return mpmc_blocking_queue_get_internal(bq, element, 0);
+}
+
+#endif
+#endif
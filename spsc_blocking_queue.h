@@ -0,0 +1,374 @@
+#ifndef C_FEK_SPSC_BLOCKING_QUEUE
+#define C_FEK_SPSC_BLOCKING_QUEUE
+
+/*
+	Author: Felipe Einsfeld Kersting
+
+	MIT License
+
+	Copyright (c) 2020 Felipe Kersting
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+
+	To use this blocking queue, define C_FEK_SPSC_BLOCKING_QUEUE_IMPLEMENTATION before including spsc_blocking_queue.h in one of your
+	source files.
+
+	To use this blocking queue, you must link your binary with pthread.
+
+	This is a single-producer/single-consumer (SPSC) variant of the blocking queue in blocking_queue.h. It has the same
+	add/put/poll/take/close/destroy API and returns the same BQ_* codes, but it may only be used by exactly ONE producer thread
+	(calling _add/_put) and ONE consumer thread (calling _poll/_take). Using it from more threads causes undefined behavior.
+
+	Since there is only one caller on each side, there is no need for fair locks: elements are exchanged through a lock-free ring,
+	whose head and tail indexes live in separate cache lines. The mutex and the conds are only touched when the ring is empty
+	(consumer) or full (producer) and the caller must be parked, and when the other side is parked and must be woken up.
+
+	This blocking queue has the following properties/features:
+
+	- It has a fixed capacity, provided by the caller. The capacity is rounded up to the next power of two.
+	- It allows the producer to add elements to the queue via both a blocking call and a non-blocking call.
+	- It allows the consumer to get elements from the queue via both a blocking call and a non-blocking call.
+
+	Unlike blocking_queue.h, there is no boundless mode.
+
+	Define C_FEK_SPSC_BLOCKING_QUEUE_NO_CRT if you don't want the C Runtime Library included. If this is defined, you must provide
+	implementations for the following functions:
+
+	void* malloc(unsigned int size)
+	void  free(void* block)
+
+	On Linux, the producer and the consumer do not pay for a full memory fence on every call to find out whether the other side
+	is parked: the side that is about to park fences both threads with membarrier (Linux 4.14+) instead. Define
+	C_FEK_SPSC_BLOCKING_QUEUE_NO_MEMBARRIER to fence on every call instead, which is also done if membarrier is not available.
+
+	Define C_FEK_SPSC_BLOCKING_QUEUE_CACHE_LINE_SIZE to change the cache line size used to separate the producer and consumer
+	indexes (defaults to 64).
+
+	For more information about the API, check the comments in the function signatures.
+
+	https://github.com/felipeek/c-fifo-blocking-queue
+*/
+
+#include "blocking_queue.h"
+
+#ifndef C_FEK_SPSC_BLOCKING_QUEUE_CACHE_LINE_SIZE
+#define C_FEK_SPSC_BLOCKING_QUEUE_CACHE_LINE_SIZE 64
+#endif
+
+#if defined(__linux__) && !defined(C_FEK_SPSC_BLOCKING_QUEUE_NO_MEMBARRIER)
+#define C_FEK_SPSC_BLOCKING_QUEUE_USE_MEMBARRIER
+#endif
+
+// This structure is reserved for internal-use only
+typedef struct {
+	// Producer-owned. Position where the next element will be written. Only grows, wraps around at UINT_MAX.
+	unsigned int tail __attribute__((aligned(C_FEK_SPSC_BLOCKING_QUEUE_CACHE_LINE_SIZE)));
+	// Last value of 'head' seen by the producer. Avoids touching the consumer cache line when the ring is not full.
+	unsigned int cached_head;
+	// Consumer-owned. Position of the next element to be read. Only grows, wraps around at UINT_MAX.
+	unsigned int head __attribute__((aligned(C_FEK_SPSC_BLOCKING_QUEUE_CACHE_LINE_SIZE)));
+	// Last value of 'tail' seen by the consumer. Avoids touching the producer cache line when the ring is not empty.
+	unsigned int cached_tail;
+	// The ring of elements. Its capacity is always a power of two.
+	void** queue __attribute__((aligned(C_FEK_SPSC_BLOCKING_QUEUE_CACHE_LINE_SIZE)));
+	// The capacity of the ring
+	unsigned int queue_capacity;
+	// queue_capacity - 1
+	unsigned int queue_mask;
+	// Indicates whether the queue was closed.
+	int closed;
+	// Set while the producer is parked (or about to park) waiting for space. See SPSC_WAITING.
+	int producer_waiting;
+	// Set while the consumer is parked (or about to park) waiting for an element. See SPSC_WAITING.
+	int consumer_waiting;
+	// If true, the side about to park fences both threads with membarrier, so the other side does not fence on every call
+	int use_membarrier;
+	// Mutex protecting the slow path
+	pthread_mutex_t mutex;
+	// Cond used to wake up the consumer
+	pthread_cond_t not_empty_cond;
+	// Cond used to wake up the producer
+	pthread_cond_t not_full_cond;
+	// Cond used to wait for parked callers to leave when the queue is closed
+	pthread_cond_t close_cond;
+} Spsc_Blocking_Queue;
+
+// Init the SPSC blocking queue.
+// The capacity is given by 'capacity', which is rounded up to the next power of two. It must be > 0.
+// Returns 0 if success, -1 if error.
+int spsc_blocking_queue_init(Spsc_Blocking_Queue* bq, unsigned int capacity);
+// Adds an element to the queue. Must only be called by the producer thread.
+// This function does NOT block the caller.
+// Returns:
+// * 0 if success
+// * BQ_FULL if the there is no space in the queue
+// * BQ_CLOSED if the queue was closed
+int spsc_blocking_queue_add(Spsc_Blocking_Queue* bq, void* element);
+// Puts an element to the queue. Must only be called by the producer thread.
+// If the queue is full, the caller is blocked until there is space in the queue for the new element.
+// Returns:
+// * 0 if success
+// * BQ_CLOSED if the queue was closed while the call was blocked
+int spsc_blocking_queue_put(Spsc_Blocking_Queue* bq, void* element);
+// Poll an element from the queue. Must only be called by the consumer thread.
+// The element is stored in '*element'
+// This function does NOT block the caller.
+// Returns:
+// * 0 if success
+// * BQ_EMPTY if the queue is empty
+// * BQ_CLOSED if the queue was closed
+int spsc_blocking_queue_poll(Spsc_Blocking_Queue* bq, void* element);
+// Take an element from the queue. Must only be called by the consumer thread.
+// The element is stored in '*element'
+// If the queue is empty, the caller is blocked until there is an element available to take.
+// Returns:
+// * 0 if success
+// * BQ_CLOSED if the queue was closed while the call was blocked
+int spsc_blocking_queue_take(Spsc_Blocking_Queue* bq, void* element);
+// Closes the queue.
+// When the queue is closed, all _add/_put/_poll/_take calls will immediately return BQ_CLOSED if called.
+// If the producer or the consumer are blocked in one of these calls, they are unblocked and receive BQ_CLOSED before this
+// function returns.
+// Calling this function multiple times is allowed.
+void spsc_blocking_queue_close(Spsc_Blocking_Queue* bq);
+// Destroys the queue, closing it first if needed.
+// Unlike 'blocking_queue_destroy', this function does not track callers that are not blocked, so it must only be called once
+// the producer and the consumer are done calling the queue (e.g. after they received BQ_CLOSED and were joined).
+void spsc_blocking_queue_destroy(Spsc_Blocking_Queue* bq);
+
+#ifdef C_FEK_SPSC_BLOCKING_QUEUE_IMPLEMENTATION
+#if !defined(C_FEK_SPSC_BLOCKING_QUEUE_NO_CRT)
+#include <stdlib.h>
+#endif
+#if defined(C_FEK_SPSC_BLOCKING_QUEUE_USE_MEMBARRIER)
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Returns true if membarrier can fence all the threads of the process. Registers the process for it the first time.
+static int spsc_has_membarrier(void) {
+#if defined(C_FEK_SPSC_BLOCKING_QUEUE_USE_MEMBARRIER) && defined(SYS_membarrier)
+	// 0 if not checked yet, 1 if supported, 2 otherwise
+	static int support = 0;
+	int current = __atomic_load_n(&support, __ATOMIC_RELAXED);
+	if (current == 0) {
+		long commands = syscall(SYS_membarrier, MEMBARRIER_CMD_QUERY, 0, 0);
+		current = commands > 0 && (commands & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+			syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0 ? 1 : 2;
+		__atomic_store_n(&support, current, __ATOMIC_RELAXED);
+	}
+	return current == 1;
+#else
+	return 0;
+#endif
+}
+
+// Values of 'producer_waiting'/'consumer_waiting'
+// The side is not parked
+#define SPSC_NOT_WAITING 0
+// The side is parked (or about to park) and must be signaled
+#define SPSC_WAITING 1
+// The side is parked and was already signaled: until it runs again, the other side does not signal it again on every call
+#define SPSC_SIGNALED 2
+
+int spsc_blocking_queue_init(Spsc_Blocking_Queue* bq, unsigned int capacity) {
+	if (capacity == 0 || capacity > 0x80000000u) {
+		return -1;
+	}
+
+	if (pthread_mutex_init(&bq->mutex, NULL)) {
+		return -1;
+	}
+
+	if (pthread_cond_init(&bq->not_empty_cond, NULL)) {
+		pthread_mutex_destroy(&bq->mutex);
+		return -1;
+	}
+
+	if (pthread_cond_init(&bq->not_full_cond, NULL)) {
+		pthread_mutex_destroy(&bq->mutex);
+		pthread_cond_destroy(&bq->not_empty_cond);
+		return -1;
+	}
+
+	if (pthread_cond_init(&bq->close_cond, NULL)) {
+		pthread_mutex_destroy(&bq->mutex);
+		pthread_cond_destroy(&bq->not_empty_cond);
+		pthread_cond_destroy(&bq->not_full_cond);
+		return -1;
+	}
+
+	bq->queue_capacity = 1;
+	while (bq->queue_capacity < capacity) {
+		bq->queue_capacity <<= 1;
+	}
+	bq->queue_mask = bq->queue_capacity - 1;
+	bq->head = 0;
+	bq->tail = 0;
+	bq->cached_head = 0;
+	bq->cached_tail = 0;
+	bq->closed = 0;
+	bq->producer_waiting = SPSC_NOT_WAITING;
+	bq->consumer_waiting = SPSC_NOT_WAITING;
+	bq->use_membarrier = spsc_has_membarrier();
+	bq->queue = (void**)malloc(bq->queue_capacity * sizeof(void*));
+	if (bq->queue == NULL) {
+		pthread_mutex_destroy(&bq->mutex);
+		pthread_cond_destroy(&bq->not_empty_cond);
+		pthread_cond_destroy(&bq->not_full_cond);
+		pthread_cond_destroy(&bq->close_cond);
+		return -1;
+	}
+
+	return 0;
+}
+
+void spsc_blocking_queue_close(Spsc_Blocking_Queue* bq) {
+	pthread_mutex_lock(&bq->mutex);
+	__atomic_store_n(&bq->closed, 1, __ATOMIC_SEQ_CST);
+	pthread_cond_broadcast(&bq->not_empty_cond);
+	pthread_cond_broadcast(&bq->not_full_cond);
+	while (bq->producer_waiting || bq->consumer_waiting) {
+		pthread_cond_wait(&bq->close_cond, &bq->mutex);
+	}
+	pthread_mutex_unlock(&bq->mutex);
+}
+
+void spsc_blocking_queue_destroy(Spsc_Blocking_Queue* bq) {
+	spsc_blocking_queue_close(bq);
+	free(bq->queue);
+	pthread_cond_destroy(&bq->not_empty_cond);
+	pthread_cond_destroy(&bq->not_full_cond);
+	pthread_cond_destroy(&bq->close_cond);
+	pthread_mutex_destroy(&bq->mutex);
+}
+
+// Wakes up the other side if it is parked on 'cond'.
+// The fence pairs with the one in 'spsc_park': either the parked side sees the index that was just published, or we see its
+// 'waiting' flag. With membarrier, 'spsc_park' fences this thread too, so a compiler barrier is enough here.
+static void spsc_wake(Spsc_Blocking_Queue* bq, int* waiting, pthread_cond_t* cond) {
+	if (bq->use_membarrier) {
+		__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	} else {
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	}
+	if (__atomic_load_n(waiting, __ATOMIC_RELAXED) == SPSC_WAITING) {
+		pthread_mutex_lock(&bq->mutex);
+		if (*waiting == SPSC_WAITING) {
+			__atomic_store_n(waiting, SPSC_SIGNALED, __ATOMIC_RELAXED);
+			pthread_cond_signal(cond);
+		}
+		pthread_mutex_unlock(&bq->mutex);
+	}
+}
+
+// Parks the caller on 'cond' until the index '*index' changes from 'value' or the queue is closed.
+static void spsc_park(Spsc_Blocking_Queue* bq, int* waiting, pthread_cond_t* cond, unsigned int* index, unsigned int value) {
+	pthread_mutex_lock(&bq->mutex);
+	while (__atomic_load_n(index, __ATOMIC_ACQUIRE) == value && !__atomic_load_n(&bq->closed, __ATOMIC_RELAXED)) {
+		if (*waiting != SPSC_WAITING) {
+			// (Re-)arm the flag, then check the index again before sleeping
+			__atomic_store_n(waiting, SPSC_WAITING, __ATOMIC_RELAXED);
+#if defined(C_FEK_SPSC_BLOCKING_QUEUE_USE_MEMBARRIER) && defined(SYS_membarrier)
+			if (bq->use_membarrier) {
+				// Issues a full fence in the other side as well, if it is running
+				syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+			}
+#endif
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			continue;
+		}
+		pthread_cond_wait(cond, &bq->mutex);
+	}
+	__atomic_store_n(waiting, SPSC_NOT_WAITING, __ATOMIC_RELAXED);
+	if (__atomic_load_n(&bq->closed, __ATOMIC_RELAXED)) {
+		pthread_cond_signal(&bq->close_cond);
+	}
+	pthread_mutex_unlock(&bq->mutex);
+}
+
+static int spsc_blocking_queue_add_internal(Spsc_Blocking_Queue* bq, void* element, int async) {
+	unsigned int tail = bq->tail;
+	while (1) {
+		if (__atomic_load_n(&bq->closed, __ATOMIC_RELAXED)) {
+			return BQ_CLOSED;
+		}
+		if (tail - bq->cached_head < bq->queue_capacity) {
+			break;
+		}
+		bq->cached_head = __atomic_load_n(&bq->head, __ATOMIC_ACQUIRE);
+		if (tail - bq->cached_head < bq->queue_capacity) {
+			break;
+		}
+		if (async) {
+			return BQ_FULL;
+		}
+		spsc_park(bq, &bq->producer_waiting, &bq->not_full_cond, &bq->head, bq->cached_head);
+	}
+
+	bq->queue[tail & bq->queue_mask] = element;
+	__atomic_store_n(&bq->tail, tail + 1, __ATOMIC_RELEASE);
+	spsc_wake(bq, &bq->consumer_waiting, &bq->not_empty_cond);
+	return 0;
+}
+
+static int spsc_blocking_queue_get_internal(Spsc_Blocking_Queue* bq, void* element, int async) {
+	unsigned int head = bq->head;
+	while (1) {
+		if (__atomic_load_n(&bq->closed, __ATOMIC_RELAXED)) {
+			return BQ_CLOSED;
+		}
+		if (head != bq->cached_tail) {
+			break;
+		}
+		bq->cached_tail = __atomic_load_n(&bq->tail, __ATOMIC_ACQUIRE);
+		if (head != bq->cached_tail) {
+			break;
+		}
+		if (async) {
+			return BQ_EMPTY;
+		}
+		spsc_park(bq, &bq->consumer_waiting, &bq->not_empty_cond, &bq->tail, bq->cached_tail);
+	}
+
+	*(void**)element = bq->queue[head & bq->queue_mask];
+	__atomic_store_n(&bq->head, head + 1, __ATOMIC_RELEASE);
+	spsc_wake(bq, &bq->producer_waiting, &bq->not_full_cond);
+	return 0;
+}
+
+int spsc_blocking_queue_add(Spsc_Blocking_Queue* bq, void* element) {
+	return spsc_blocking_queue_add_internal(bq, element, 1);
+}
+
+int spsc_blocking_queue_put(Spsc_Blocking_Queue* bq, void* element) {
+	return spsc_blocking_queue_add_internal(bq, element, 0);
+}
+
+int spsc_blocking_queue_poll(Spsc_Blocking_Queue* bq, void* element) {
+	return spsc_blocking_queue_get_internal(bq, element, 1);
+}
+
+int spsc_blocking_queue_take(Spsc_Blocking_Queue* bq, void* element) {
+	return spsc_blocking_queue_get_internal(bq, element, 0);
+}
+
+#endif
+#endif
@@ -1,3 +1,9 @@
+#ifdef TEST_SPIN_POLICY
+// Number of waits of each kind (indexed by BQ_WAIT_*)
+static unsigned long long waits[4];
+#define C_FEK_BLOCKING_QUEUE_WAIT_HOOK(bq, kind, ns) ((void)(ns), __atomic_add_fetch(&waits[kind], 1, __ATOMIC_RELAXED))
+#endif
+
 #define C_FEK_BLOCKING_QUEUE_IMPLEMENTATION
 #define C_FEK_FAIR_LOCK_IMPLEMENTATION
 #include "../blocking_queue.h"
@@ -98,7 +104,19 @@ int main(int argc, char** argv) {
 	producer_threads = malloc(num_producer_threads * sizeof(pthread_t));
 	consumer_threads = malloc(num_consumer_threads * sizeof(pthread_t));
 
+#if defined(TEST_SPIN_POLICY) || defined(TEST_STATS)
+	Blocking_Queue_Options options = {0};
+#ifdef TEST_SPIN_POLICY
+	options.spin_policy.max_iterations = 8;
+	options.spin_policy.max_ns = 5000;
+#endif
+#ifdef TEST_STATS
+	options.collect_stats = 1;
+#endif
+	blocking_queue_init_with_options(&bq, BLOCKING_QUEUE_CAPACITY, &options);
+#else
 	blocking_queue_init(&bq, BLOCKING_QUEUE_CAPACITY);
+#endif
 
 	for (unsigned int i = 0; i < data_size; ++i) {
 		produced[i] = i;
@@ -134,6 +152,43 @@ int main(int argc, char** argv) {
 		assert(produced[i] == consumed[i]);
 	}
 
+	Blocking_Queue_Wakeup_Stats wakeup_stats;
+	blocking_queue_get_wakeup_stats(&bq, &wakeup_stats);
+	printf("Wake-up stats: %llu signaled, %llu elided\n", wakeup_stats.wakeups_signaled, wakeup_stats.wakeups_elided);
+	assert(wakeup_stats.wakeups_signaled + wakeup_stats.wakeups_elided == 2 * (unsigned long long)data_size);
+
+#ifdef TEST_SPIN_POLICY
+	Blocking_Queue_Spin_Stats stats;
+	blocking_queue_get_spin_stats(&bq, &stats);
+	// Every wait for the queue to become non-full/non-empty spins first, then parks if the spin failed
+	unsigned long long queue_waits = waits[BQ_WAIT_NOT_FULL] + waits[BQ_WAIT_NOT_EMPTY];
+	assert(stats.wait_spin_successes + stats.wait_spin_failures == queue_waits);
+	// The lock hook also counts the callers that took the lock right away, without spinning
+	assert(stats.lock_spin_successes + stats.lock_spin_failures <= waits[BQ_WAIT_ADD_LOCK] + waits[BQ_WAIT_GET_LOCK]);
+	if (num_producer_threads == 1 && num_consumer_threads == 1) {
+		// The queue is much smaller than the data, so the producer or the consumer had to wait for the other one
+		assert(queue_waits > 0);
+		// Nobody else ever waits for the fair locks
+		assert(stats.lock_spin_successes + stats.lock_spin_failures == 0);
+	}
+#endif
+
+#ifdef TEST_STATS
+	Blocking_Queue_Stats bq_stats;
+	blocking_queue_get_stats(&bq, &bq_stats);
+	printf("Stats: %llu puts, %llu takes, max size %u, blocked %llu/%llu ns (not full/not empty), max waiting %d/%d (add/get)\n",
+		bq_stats.puts, bq_stats.takes, bq_stats.max_queue_size, bq_stats.not_full_blocked_ns, bq_stats.not_empty_blocked_ns,
+		bq_stats.max_add_lock_waiting_threads, bq_stats.max_get_lock_waiting_threads);
+	assert(bq_stats.puts == data_size);
+	assert(bq_stats.takes == data_size);
+	assert(bq_stats.full_rejections == 0 && bq_stats.empty_rejections == 0);
+	assert(bq_stats.grow_events == 0);
+	assert(bq_stats.max_queue_size > 0 && bq_stats.max_queue_size <= BLOCKING_QUEUE_CAPACITY);
+	assert(bq_stats.max_add_lock_waiting_threads < num_producer_threads);
+	assert(bq_stats.max_get_lock_waiting_threads < num_consumer_threads);
+	assert(bq_stats.wakeups.wakeups_signaled == wakeup_stats.wakeups_signaled);
+#endif
+
 	blocking_queue_destroy(&bq);
 	free(produced);
 	free(consumed);
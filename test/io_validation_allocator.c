@@ -0,0 +1,221 @@
+#define C_FEK_BLOCKING_QUEUE_IMPLEMENTATION
+#define C_FEK_FAIR_LOCK_IMPLEMENTATION
+#include "../blocking_queue.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Allocator that tags every block, so the queue must give each block back to the allocator it came from, with its size
+
+#define BLOCK_MAGIC 0x5eed5eedu
+
+typedef struct {
+	unsigned int magic;
+	size_t size;
+	// Keeps the block aligned as malloc would
+	long double alignment;
+} Block_Header;
+
+typedef struct {
+	unsigned long long allocations;
+	unsigned long long frees;
+	unsigned long long bytes_in_use;
+} Counting_Allocator;
+
+static void* counting_alloc(void* ctx, size_t size) {
+	Counting_Allocator* allocator = ctx;
+	Block_Header* header = malloc(sizeof(Block_Header) + size);
+	if (header == NULL) {
+		return NULL;
+	}
+	header->magic = BLOCK_MAGIC;
+	header->size = size;
+	__atomic_add_fetch(&allocator->allocations, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocator->bytes_in_use, size, __ATOMIC_RELAXED);
+	return header + 1;
+}
+
+static void counting_free(void* ctx, void* block, size_t size) {
+	Counting_Allocator* allocator = ctx;
+	Block_Header* header = (Block_Header*)block - 1;
+	assert(header->magic == BLOCK_MAGIC && header->size == size);
+	header->magic = 0;
+	__atomic_add_fetch(&allocator->frees, 1, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&allocator->bytes_in_use, size, __ATOMIC_RELAXED);
+	free(header);
+}
+
+static unsigned long long reallocations;
+
+static void* counting_realloc(void* ctx, void* block, size_t old_size, size_t new_size) {
+	Counting_Allocator* allocator = ctx;
+	Block_Header* header = (Block_Header*)block - 1;
+	assert(header->magic == BLOCK_MAGIC && header->size == old_size);
+	header = realloc(header, sizeof(Block_Header) + new_size);
+	if (header == NULL) {
+		return NULL;
+	}
+	header->size = new_size;
+	++reallocations;
+	__atomic_add_fetch(&allocator->bytes_in_use, new_size - old_size, __ATOMIC_RELAXED);
+	return header + 1;
+}
+
+static Blocking_Queue bq;
+static Counting_Allocator counting_allocator;
+
+// Resizing keeps the contents, with and without the 'realloc' callback
+static void check_realloc() {
+	Counting_Allocator ctx = {0};
+	Fair_Lock_Allocator allocator = {0};
+	allocator.alloc = counting_alloc;
+	allocator.free = counting_free;
+	allocator.ctx = &ctx;
+
+	for (int with_realloc = 0; with_realloc < 2; ++with_realloc) {
+		allocator.realloc = with_realloc ? counting_realloc : NULL;
+		reallocations = 0;
+		unsigned char* block = allocator.alloc(allocator.ctx, 16);
+		for (int i = 0; i < 16; ++i) {
+			block[i] = (unsigned char)i;
+		}
+		block = fair_lock_allocator_realloc(&allocator, block, 16, 64);
+		assert(block && ctx.bytes_in_use == 64);
+		block = fair_lock_allocator_realloc(&allocator, block, 64, 8);
+		assert(block && ctx.bytes_in_use == 8);
+		for (int i = 0; i < 8; ++i) {
+			assert(block[i] == i);
+		}
+		assert(reallocations == (with_realloc ? 2 : 0));
+		allocator.free(allocator.ctx, block, 8);
+		assert(ctx.bytes_in_use == 0 && ctx.allocations == ctx.frees);
+	}
+
+	// The C Runtime Library is used without an allocator
+	void* block = fair_lock_allocator_realloc(NULL, malloc(16), 16, 32);
+	assert(block);
+	free(block);
+}
+
+static int data_size;
+static int num_producer_threads;
+static int num_consumer_threads;
+
+static int* consumed;
+
+static int* producer_threads_ids;
+static int* consumer_threads_ids;
+static pthread_t* producer_threads;
+static pthread_t* consumer_threads;
+
+void* producer(void* args) {
+	int producer_id = *(int*)args;
+	unsigned int num_data_to_produce = data_size / num_producer_threads;
+	unsigned int start_at = producer_id * num_data_to_produce;
+
+	for (unsigned int i = start_at; i < start_at + num_data_to_produce; ++i) {
+		assert(!blocking_queue_put(&bq, (void*)(size_t)(i + 1)));
+	}
+
+	return 0;
+}
+
+void* consumer(void* args) {
+	int consumer_id = *(int*)args;
+	unsigned int num_data_to_consume = data_size / num_consumer_threads;
+	unsigned int start_at = consumer_id * num_data_to_consume;
+
+	for (unsigned int i = start_at; i < start_at + num_data_to_consume; ++i) {
+		void* got;
+		assert(!blocking_queue_take(&bq, &got));
+		consumed[i] = (int)(size_t)got - 1;
+	}
+
+	return 0;
+}
+
+static int compare_ints(const void* a, const void* b) {
+	return *(const int*)a - *(const int*)b;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 5) {
+		printf("usage: %s <num_producer_threads> <num_consumer_threads> <data_size> <capacity>\n", argv[0]);
+		return -1;
+	}
+
+	num_producer_threads = atoi(argv[1]);
+	num_consumer_threads = atoi(argv[2]);
+	data_size = atoi(argv[3]);
+	unsigned int capacity = atoi(argv[4]);
+	assert(data_size % num_producer_threads == 0);
+	assert(data_size % num_consumer_threads == 0);
+
+	consumed = malloc(data_size * sizeof(int));
+	producer_threads_ids = malloc(num_producer_threads * sizeof(int));
+	consumer_threads_ids = malloc(num_consumer_threads * sizeof(int));
+	producer_threads = malloc(num_producer_threads * sizeof(pthread_t));
+	consumer_threads = malloc(num_consumer_threads * sizeof(pthread_t));
+
+	check_realloc();
+
+	// An allocator with only one of 'alloc'/'free' is rejected
+	Blocking_Queue_Options options = {0};
+	options.allocator.alloc = counting_alloc;
+	assert(blocking_queue_init_with_options(&bq, capacity, &options));
+
+	options.allocator.free = counting_free;
+	options.allocator.ctx = &counting_allocator;
+	options.segment_capacity = 16;
+	assert(!blocking_queue_init_with_options(&bq, capacity, &options));
+	assert(counting_allocator.allocations == 1);
+	assert(counting_allocator.bytes_in_use == blocking_queue_get_footprint(&bq));
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		producer_threads_ids[i] = i;
+		if (pthread_create(&producer_threads[i], NULL, producer, &producer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		consumer_threads_ids[i] = i;
+		if (pthread_create(&consumer_threads[i], NULL, consumer, &consumer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		pthread_join(producer_threads[i], NULL);
+	}
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		pthread_join(consumer_threads[i], NULL);
+	}
+
+	qsort(consumed, data_size, sizeof(int), compare_ints);
+
+	for (unsigned int i = 0; i < data_size; ++i) {
+		assert(consumed[i] == i);
+	}
+
+	blocking_queue_trim(&bq);
+	blocking_queue_destroy(&bq);
+	// Everything the queue (and its fair locks) allocated was given back to the same allocator
+	assert(counting_allocator.frees == counting_allocator.allocations);
+	assert(counting_allocator.bytes_in_use == 0);
+
+	free(consumed);
+	free(producer_threads_ids);
+	free(consumer_threads_ids);
+	free(producer_threads);
+	free(consumer_threads);
+
+	printf("Test completed succesfully. [%u, %u, %u, %u] (%llu allocations)\n", num_producer_threads, num_consumer_threads,
+		data_size, capacity, counting_allocator.allocations);
+	return 0;
+}
@@ -0,0 +1,332 @@
+#define C_FEK_BLOCKING_QUEUE_IMPLEMENTATION
+#define C_FEK_FAIR_LOCK_IMPLEMENTATION
+#include "../blocking_queue.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+static Blocking_Queue bq;
+
+static int data_size;
+static int num_producer_threads;
+static int num_consumer_threads;
+
+static int* produced;
+static int* consumed;
+
+static int* producer_threads_ids;
+static int* consumer_threads_ids;
+static pthread_t* producer_threads;
+static pthread_t* consumer_threads;
+
+static int batch_size;
+
+#define BLOCKING_QUEUE_CAPACITY 4
+// Linger of the consumers that use 'blocking_queue_take_batch' (every other consumer)
+#define BATCH_LINGER_NS 50000
+
+static void heapsort(int a[], int n) {
+	int i = n / 2, parent, child, t;
+	while (1) {
+		if (i > 0) {
+			i--;
+			t = a[i];
+		} else {
+			n--;
+			if (n <= 0) return;
+			t = a[n];
+			a[n] = a[0];
+		}
+		parent = i;
+		child = i * 2 + 1;
+		while (child < n) {
+			if ((child + 1 < n) && (a[child + 1] > a[child]))
+				child++;
+			if (a[child] > t) {
+				a[parent] = a[child];
+				parent = child;
+				child = parent * 2 + 1;
+			} else {
+				break;
+			}
+		}
+		a[parent] = t;
+	}
+}
+
+void* producer(void* args) {
+	int producer_id = *(int*)args;
+	unsigned int num_data_to_consume = data_size / num_producer_threads;
+	unsigned int start_at = producer_id * num_data_to_consume;
+
+	void** batch = malloc(batch_size * sizeof(void*));
+
+	for (unsigned int i = start_at; i < start_at + num_data_to_consume; i += batch_size) {
+		unsigned int added;
+		for (unsigned int j = 0; j < batch_size; ++j) {
+			batch[j] = &produced[i + j];
+		}
+		assert(!blocking_queue_put_n(&bq, batch, batch_size, &added));
+		assert(added == batch_size);
+	}
+
+	free(batch);
+	return 0;
+}
+
+void* consumer(void* args) {
+	int consumer_id = *(int*)args;
+	unsigned int num_data_to_consume = data_size / num_consumer_threads;
+	unsigned int start_at = consumer_id * num_data_to_consume;
+
+	void** batch = malloc(batch_size * sizeof(void*));
+
+	unsigned int taken;
+	for (unsigned int i = start_at; i < start_at + num_data_to_consume; i += taken) {
+		if (consumer_id % 2) {
+			unsigned int max_n = start_at + num_data_to_consume - i;
+			if (max_n > batch_size) {
+				max_n = batch_size;
+			}
+			assert(!blocking_queue_take_batch(&bq, batch, max_n, BATCH_LINGER_NS, &taken));
+			assert(taken > 0 && taken <= max_n);
+		} else {
+			assert(!blocking_queue_take_n(&bq, batch, batch_size, &taken));
+			assert(taken == batch_size);
+		}
+		for (unsigned int j = 0; j < taken; ++j) {
+			assert(batch[j] != NULL);
+			consumed[i + j] = *(int*)batch[j];
+		}
+	}
+
+	free(batch);
+	return 0;
+}
+
+// Non-blocking calls that cannot succeed must fail without taking any lock: every lock of the queue is held while they are made
+static void check_lock_free_early_out() {
+	Blocking_Queue q;
+	Blocking_Queue_Options options = {0};
+	options.collect_stats = 1;
+	assert(!blocking_queue_init_with_options(&q, 2, &options));
+	void* elements[2] = { &q, &q };
+	void* out[2];
+	unsigned int count;
+
+	for (int round = 0; round < 3; ++round) {
+		if (round == 1) {
+			assert(!blocking_queue_add_n(&q, elements, 2, &count) && count == 2);
+		} else if (round == 2) {
+			blocking_queue_close(&q);
+		}
+		pthread_mutex_lock(&q.active_callers_mutex);
+		assert(!fair_lock_lock(&q.add_lock));
+		assert(!fair_lock_lock(&q.get_lock));
+		pthread_mutex_lock(&q.mutex);
+		if (round == 0) {
+			assert(blocking_queue_poll(&q, out) == BQ_EMPTY);
+			assert(blocking_queue_poll_n(&q, out, 2, &count) == BQ_EMPTY && count == 0);
+		} else if (round == 1) {
+			assert(blocking_queue_add(&q, &q) == BQ_FULL);
+			assert(blocking_queue_add_n(&q, elements, 2, &count) == BQ_FULL && count == 0);
+		} else {
+			assert(blocking_queue_add(&q, &q) == BQ_CLOSED);
+			assert(blocking_queue_poll(&q, out) == BQ_CLOSED);
+		}
+		pthread_mutex_unlock(&q.mutex);
+		fair_lock_unlock(&q.get_lock);
+		fair_lock_unlock(&q.add_lock);
+		pthread_mutex_unlock(&q.active_callers_mutex);
+	}
+
+	Blocking_Queue_Stats stats;
+	blocking_queue_get_stats(&q, &stats);
+	assert(stats.empty_rejections == 2 && stats.full_rejections == 2);
+	blocking_queue_destroy(&q);
+}
+
+static void* put_after_delay(void* args) {
+	Blocking_Queue* q = args;
+	for (int i = 0; i < 4; ++i) {
+		usleep(5000);
+		assert(!blocking_queue_put(q, &produced[i]));
+	}
+	return 0;
+}
+
+static Blocking_Queue* lingering_queue;
+static unsigned int lingering_taken;
+static void* out_of_linger[2];
+static int poll_result;
+static void* polled;
+
+static void* take_lingering_batch(void* args) {
+	assert(!blocking_queue_take_batch(lingering_queue, out_of_linger, 2, 10000000000ull, &lingering_taken));
+	return 0;
+}
+
+static void* poll_behind_batch(void* args) {
+	poll_result = blocking_queue_poll(lingering_queue, &polled);
+	return 0;
+}
+
+// A consumer lingering for a batch does not make the queue look empty: a poll waiting behind it is not rejected, and the linger
+// is not counted as time blocked on an empty queue
+static void check_linger_is_not_empty_wait() {
+	Blocking_Queue q;
+	Blocking_Queue_Options options = {0};
+	options.collect_stats = 1;
+	assert(!blocking_queue_init_with_options(&q, 8, &options));
+	lingering_queue = &q;
+	pthread_t batch_thread, poll_thread;
+
+	assert(!blocking_queue_put(&q, &produced[0]));
+	assert(!pthread_create(&batch_thread, NULL, take_lingering_batch, NULL));
+	unsigned int waiters = 0;
+	while (!waiters) {
+		usleep(100);
+		pthread_mutex_lock(&q.mutex);
+		waiters = q.not_empty_waiters;
+		pthread_mutex_unlock(&q.mutex);
+	}
+	assert(!pthread_create(&poll_thread, NULL, poll_behind_batch, NULL));
+	int waiting_threads = 0;
+	while (!waiting_threads) {
+		usleep(100);
+		pthread_mutex_lock(&q.get_lock.mutex);
+		waiting_threads = q.get_lock.waiting_threads;
+		pthread_mutex_unlock(&q.get_lock.mutex);
+	}
+	// Both at once, so the poll cannot find the queue empty because it ran between them
+	void* elements[2] = { &produced[1], &produced[2] };
+	unsigned int added;
+	assert(!blocking_queue_put_n(&q, elements, 2, &added) && added == 2);
+	pthread_join(batch_thread, NULL);
+	pthread_join(poll_thread, NULL);
+	assert(lingering_taken == 2 && out_of_linger[0] == &produced[0] && out_of_linger[1] == &produced[1]);
+	assert(poll_result == 0 && polled == &produced[2]);
+
+	Blocking_Queue_Stats stats;
+	blocking_queue_get_stats(&q, &stats);
+	assert(stats.empty_rejections == 0 && stats.not_empty_blocked_ns == 0);
+	blocking_queue_destroy(&q);
+}
+
+// 'blocking_queue_take_batch' returns as soon as it has 'max_n' elements, when the queue is full or when the linger expires
+static void check_take_batch() {
+	Blocking_Queue q;
+	assert(!blocking_queue_init(&q, 4));
+	void* out[8];
+	unsigned int taken;
+	pthread_t thread;
+
+	// Blocks for the first element, then takes what is available right away
+	assert(!pthread_create(&thread, NULL, put_after_delay, &q));
+	assert(!blocking_queue_take_batch(&q, out, 8, 0, &taken));
+	assert(taken >= 1 && taken < 4 && out[0] == &produced[0]);
+	// Stops lingering once 'max_n' elements are available
+	unsigned int first_taken = taken;
+	unsigned long long start = fair_lock_now_ns();
+	assert(!blocking_queue_take_batch(&q, out + first_taken, 4 - first_taken, 10000000000ull, &taken));
+	assert(taken == 4 - first_taken && fair_lock_now_ns() - start < 10000000000ull);
+	for (int i = 0; i < 4; ++i) {
+		assert(out[i] == &produced[i]);
+	}
+	pthread_join(thread, NULL);
+
+	// Stops lingering once the queue is full
+	for (int i = 0; i < 4; ++i) {
+		assert(!blocking_queue_put(&q, &produced[i]));
+	}
+	assert(!blocking_queue_take_batch(&q, out, 8, 10000000000ull, &taken));
+	assert(taken == 4 && out[3] == &produced[3]);
+
+	// Takes what is available once the linger expires
+	assert(!blocking_queue_put(&q, &produced[0]));
+	assert(!blocking_queue_put(&q, &produced[1]));
+	start = fair_lock_now_ns();
+	assert(!blocking_queue_take_batch(&q, out, 8, 20000000, &taken));
+	assert(fair_lock_now_ns() - start >= 20000000);
+	assert(taken == 2 && out[0] == &produced[0] && out[1] == &produced[1]);
+
+	blocking_queue_close(&q);
+	assert(blocking_queue_take_batch(&q, out, 8, 0, &taken) == BQ_CLOSED && taken == 0);
+	blocking_queue_destroy(&q);
+}
+
+int main(int argc, char** argv) {
+	if (argc != 5) {
+		printf("usage: %s <num_producer_threads> <num_consumer_threads> <data_size> <batch_size>\n", argv[0]);
+		return -1;
+	}
+
+	num_producer_threads = atoi(argv[1]);
+	num_consumer_threads = atoi(argv[2]);
+	data_size = atoi(argv[3]);
+	batch_size = atoi(argv[4]);
+	assert(data_size % num_producer_threads == 0);
+	assert(data_size % num_consumer_threads == 0);
+	assert((data_size / num_producer_threads) % batch_size == 0);
+	assert((data_size / num_consumer_threads) % batch_size == 0);
+
+	produced = malloc(data_size * sizeof(int));
+	consumed = malloc(data_size * sizeof(int));
+	producer_threads_ids = malloc(num_producer_threads * sizeof(int));
+	consumer_threads_ids = malloc(num_consumer_threads * sizeof(int));
+	producer_threads = malloc(num_producer_threads * sizeof(pthread_t));
+	consumer_threads = malloc(num_consumer_threads * sizeof(pthread_t));
+
+	for (unsigned int i = 0; i < data_size; ++i) {
+		produced[i] = i;
+	}
+
+	check_lock_free_early_out();
+	check_take_batch();
+	check_linger_is_not_empty_wait();
+	blocking_queue_init(&bq, BLOCKING_QUEUE_CAPACITY);
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		producer_threads_ids[i] = i;
+		if (pthread_create(&producer_threads[i], NULL, producer, &producer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		consumer_threads_ids[i] = i;
+		if (pthread_create(&consumer_threads[i], NULL, consumer, &consumer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		pthread_join(producer_threads[i], NULL);
+	}
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		pthread_join(consumer_threads[i], NULL);
+	}
+
+	heapsort(consumed, data_size);
+
+	for (unsigned int i = 0; i < data_size; ++i) {
+		assert(produced[i] == consumed[i]);
+	}
+
+	blocking_queue_destroy(&bq);
+	free(produced);
+	free(consumed);
+	free(producer_threads_ids);
+	free(consumer_threads_ids);
+	free(producer_threads);
+	free(consumer_threads);
+
+	printf("Test completed succesfully. [%u, %u, %u, %u]\n", num_producer_threads, num_consumer_threads, data_size, batch_size);
+	return 0;
+}
\ No newline at end of file
@@ -50,6 +50,57 @@ static void heapsort(int a[], int n) {
 	}
 }
 
+// A burst grows the queue to hundreds of segments: once it is drained, most of them must have been given back
+static void check_memory_give_back(unsigned int segment_capacity) {
+	Blocking_Queue burst_bq;
+	Blocking_Queue_Options options = {0};
+	options.collect_stats = 1;
+	options.segment_capacity = segment_capacity;
+	assert(!blocking_queue_init_with_options(&burst_bq, 0, &options));
+	unsigned long long segment_footprint = blocking_queue_get_footprint(&burst_bq);
+	unsigned int burst = 256 * segment_capacity;
+
+	for (unsigned int i = 0; i < burst; ++i) {
+		assert(!blocking_queue_put(&burst_bq, (void*)(size_t)(i + 1)));
+	}
+	unsigned long long peak_footprint = blocking_queue_get_footprint(&burst_bq);
+	assert(peak_footprint == 256 * segment_footprint);
+
+	for (unsigned int i = 0; i < burst; ++i) {
+		void* got;
+		assert(!blocking_queue_take(&burst_bq, &got) && got == (void*)(size_t)(i + 1));
+	}
+	unsigned long long drained_footprint = blocking_queue_get_footprint(&burst_bq);
+	assert(drained_footprint <= peak_footprint / 4);
+
+	Blocking_Queue_Stats stats;
+	blocking_queue_get_stats(&burst_bq, &stats);
+	assert(stats.shrink_events > 0);
+
+	// Only the segment holding the front and the rear of the (empty) queue is left
+	assert(blocking_queue_trim(&burst_bq) == drained_footprint - segment_footprint);
+	assert(blocking_queue_get_footprint(&burst_bq) == segment_footprint);
+	assert(blocking_queue_trim(&burst_bq) == 0);
+
+	// A burst too short for the shrink policy, after which the queue goes idle: the spare segments are given back as soon as it
+	// is empty, but for one
+	unsigned int short_burst = (BQ_SHRINK_DELAY / 2) * segment_capacity;
+	for (unsigned int i = 0; i < short_burst; ++i) {
+		assert(!blocking_queue_put(&burst_bq, (void*)(size_t)(i + 1)));
+	}
+	assert(blocking_queue_get_footprint(&burst_bq) >= (BQ_SHRINK_DELAY / 2) * segment_footprint);
+	unsigned long long shrink_events = stats.shrink_events;
+	for (unsigned int i = 0; i < short_burst; ++i) {
+		void* got;
+		assert(!blocking_queue_take(&burst_bq, &got) && got == (void*)(size_t)(i + 1));
+	}
+	assert(blocking_queue_get_footprint(&burst_bq) <= 2 * segment_footprint);
+	blocking_queue_get_stats(&burst_bq, &stats);
+	assert(stats.shrink_events > shrink_events);
+
+	blocking_queue_destroy(&burst_bq);
+}
+
 void* producer(void* args) {
 	int producer_id = *(int*)args;
 	unsigned int num_data_to_consume = data_size / num_producer_threads;
@@ -78,14 +129,15 @@ void* consumer(void* args) {
 }
 
 int main(int argc, char** argv) {
-	if (argc != 4) {
-		printf("usage: %s <num_producer_threads> <num_consumer_threads> <data_size>\n", argv[0]);
+	if (argc != 4 && argc != 5) {
+		printf("usage: %s <num_producer_threads> <num_consumer_threads> <data_size> [segment_capacity]\n", argv[0]);
 		return -1;
 	}
 
 	num_producer_threads = atoi(argv[1]);
 	num_consumer_threads = atoi(argv[2]);
 	data_size = atoi(argv[3]);
+	unsigned int segment_capacity = argc == 5 ? atoi(argv[4]) : BQ_DEFAULT_SEGMENT_CAPACITY;
 	assert(data_size % num_producer_threads == 0);
 	assert(data_size % num_consumer_threads == 0);
 
@@ -96,7 +148,12 @@ int main(int argc, char** argv) {
 	producer_threads = malloc(num_producer_threads * sizeof(pthread_t));
 	consumer_threads = malloc(num_consumer_threads * sizeof(pthread_t));
 
-	blocking_queue_init(&bq, 0);
+	check_memory_give_back(segment_capacity);
+
+	Blocking_Queue_Options options = {0};
+	options.collect_stats = 1;
+	options.segment_capacity = segment_capacity;
+	blocking_queue_init_with_options(&bq, 0, &options);
 
 	for (unsigned int i = 0; i < data_size; ++i) {
 		produced[i] = i;
@@ -132,6 +189,13 @@ int main(int argc, char** argv) {
 		assert(produced[i] == consumed[i]);
 	}
 
+	Blocking_Queue_Stats stats;
+	blocking_queue_get_stats(&bq, &stats);
+	assert(stats.puts == data_size && stats.takes == data_size);
+	// The queue starts with a single segment and links one more every time it grows
+	assert((stats.grow_events + 1) * segment_capacity >= stats.max_queue_size);
+	assert(stats.not_full_blocked_ns == 0);
+
 	blocking_queue_destroy(&bq);
 	free(produced);
 	free(consumed);
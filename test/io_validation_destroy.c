@@ -73,7 +73,9 @@ int main(int argc, char** argv) {
 	}
 
 	usleep(TIME_TO_DESTROY_MS * 1000);
+	unsigned long long close_start = fair_lock_now_ns();
 	blocking_queue_close(&bq);
+	printf("Close took %llu us\n", (fair_lock_now_ns() - close_start) / 1000);
 
 	for (unsigned int i = 0; i < num_producer_threads; ++i) {
 		pthread_join(producer_threads[i], NULL);
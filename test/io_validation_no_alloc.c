@@ -0,0 +1,160 @@
+#define C_FEK_BLOCKING_QUEUE_IMPLEMENTATION
+#define C_FEK_FAIR_LOCK_IMPLEMENTATION
+#include "../blocking_queue.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sched.h>
+
+// The queue uses a caller-provided buffer and preallocated waiter slots: once initialized, it must not allocate anymore.
+// Allocations are counted through the queue allocator.
+
+static unsigned long long allocations;
+
+static void* counting_alloc(void* ctx, size_t size) {
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	return malloc(size);
+}
+
+static void counting_free(void* ctx, void* block, size_t size) {
+	free(block);
+}
+
+static Blocking_Queue bq;
+
+static int data_size;
+static int num_producer_threads;
+static int num_consumer_threads;
+
+static int* consumed;
+
+static int* producer_threads_ids;
+static int* consumer_threads_ids;
+static pthread_t* producer_threads;
+static pthread_t* consumer_threads;
+
+void* producer(void* args) {
+	int producer_id = *(int*)args;
+	unsigned int num_data_to_produce = data_size / num_producer_threads;
+	unsigned int start_at = producer_id * num_data_to_produce;
+
+	for (unsigned int i = start_at; i < start_at + num_data_to_produce; ++i) {
+		if (i % 2) {
+			assert(!blocking_queue_put(&bq, (void*)(size_t)(i + 1)));
+		} else {
+			int ret;
+			while ((ret = blocking_queue_add(&bq, (void*)(size_t)(i + 1))) == BQ_FULL) {
+				sched_yield();
+			}
+			assert(ret == 0);
+		}
+	}
+
+	return 0;
+}
+
+void* consumer(void* args) {
+	int consumer_id = *(int*)args;
+	unsigned int num_data_to_consume = data_size / num_consumer_threads;
+	unsigned int start_at = consumer_id * num_data_to_consume;
+
+	for (unsigned int i = start_at; i < start_at + num_data_to_consume; ++i) {
+		void* got;
+		if (i % 2) {
+			assert(!blocking_queue_take(&bq, &got));
+		} else {
+			int ret;
+			while ((ret = blocking_queue_poll(&bq, &got)) == BQ_EMPTY) {
+				sched_yield();
+			}
+			assert(ret == 0);
+		}
+		consumed[i] = (int)(size_t)got - 1;
+	}
+
+	return 0;
+}
+
+static int compare_ints(const void* a, const void* b) {
+	return *(const int*)a - *(const int*)b;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 5) {
+		printf("usage: %s <num_producer_threads> <num_consumer_threads> <data_size> <capacity>\n", argv[0]);
+		return -1;
+	}
+
+	num_producer_threads = atoi(argv[1]);
+	num_consumer_threads = atoi(argv[2]);
+	data_size = atoi(argv[3]);
+	unsigned int capacity = atoi(argv[4]);
+	assert(data_size % num_producer_threads == 0);
+	assert(data_size % num_consumer_threads == 0);
+
+	consumed = malloc(data_size * sizeof(int));
+	producer_threads_ids = malloc(num_producer_threads * sizeof(int));
+	consumer_threads_ids = malloc(num_consumer_threads * sizeof(int));
+	producer_threads = malloc(num_producer_threads * sizeof(pthread_t));
+	consumer_threads = malloc(num_consumer_threads * sizeof(pthread_t));
+	void** buffer = malloc(capacity * sizeof(void*));
+
+	Blocking_Queue_Options options = {0};
+	options.allocator.alloc = counting_alloc;
+	options.allocator.free = counting_free;
+	options.preallocated_waiters = num_producer_threads > num_consumer_threads ? num_producer_threads : num_consumer_threads;
+	assert(blocking_queue_init_with_buffer(&bq, 0, buffer, &options));
+	assert(blocking_queue_init_with_buffer(&bq, capacity, NULL, &options));
+	allocations = 0;
+	assert(!blocking_queue_init_with_buffer(&bq, capacity, buffer, &options));
+	// Only the waiter slots of both fair locks were allocated
+	assert(allocations == 2 * options.preallocated_waiters);
+	assert(blocking_queue_get_footprint(&bq) == capacity * sizeof(void*));
+	unsigned long long allocations_after_init = allocations;
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		producer_threads_ids[i] = i;
+		if (pthread_create(&producer_threads[i], NULL, producer, &producer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		consumer_threads_ids[i] = i;
+		if (pthread_create(&consumer_threads[i], NULL, consumer, &consumer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		pthread_join(producer_threads[i], NULL);
+	}
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		pthread_join(consumer_threads[i], NULL);
+	}
+
+	assert(allocations == allocations_after_init);
+
+	qsort(consumed, data_size, sizeof(int), compare_ints);
+
+	for (unsigned int i = 0; i < data_size; ++i) {
+		assert(consumed[i] == i);
+	}
+
+	// The buffer still belongs to the caller
+	blocking_queue_destroy(&bq);
+	free(buffer);
+	free(consumed);
+	free(producer_threads_ids);
+	free(consumer_threads_ids);
+	free(producer_threads);
+	free(consumer_threads);
+
+	printf("Test completed succesfully. [%u, %u, %u, %u]\n", num_producer_threads, num_consumer_threads, data_size, capacity);
+	return 0;
+}
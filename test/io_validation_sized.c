@@ -0,0 +1,157 @@
+#define C_FEK_BLOCKING_QUEUE_IMPLEMENTATION
+#define C_FEK_FAIR_LOCK_IMPLEMENTATION
+#include "../blocking_queue.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Records are 'element_size' bytes: an int with the value, followed by bytes derived from it
+
+static Blocking_Queue bq;
+
+static int data_size;
+static int num_producer_threads;
+static int num_consumer_threads;
+static unsigned int element_size;
+
+static int* consumed;
+
+static int* producer_threads_ids;
+static int* consumer_threads_ids;
+static pthread_t* producer_threads;
+static pthread_t* consumer_threads;
+
+static void fill_record(unsigned char* record, int value) {
+	memcpy(record, &value, sizeof(int));
+	for (unsigned int i = sizeof(int); i < element_size; ++i) {
+		record[i] = (unsigned char)(value * 31 + i);
+	}
+}
+
+static int check_record(const unsigned char* record) {
+	int value;
+	memcpy(&value, record, sizeof(int));
+	for (unsigned int i = sizeof(int); i < element_size; ++i) {
+		assert(record[i] == (unsigned char)(value * 31 + i));
+	}
+	return value;
+}
+
+void* producer(void* args) {
+	int producer_id = *(int*)args;
+	unsigned int num_data_to_produce = data_size / num_producer_threads;
+	unsigned int start_at = producer_id * num_data_to_produce;
+	unsigned char* record = malloc(element_size);
+
+	for (unsigned int i = start_at; i < start_at + num_data_to_produce; ++i) {
+		fill_record(record, i);
+		assert(!blocking_queue_put(&bq, record));
+	}
+
+	free(record);
+	return 0;
+}
+
+void* consumer(void* args) {
+	int consumer_id = *(int*)args;
+	unsigned int num_data_to_consume = data_size / num_consumer_threads;
+	unsigned int start_at = consumer_id * num_data_to_consume;
+	unsigned char* record = malloc(element_size);
+
+	for (unsigned int i = start_at; i < start_at + num_data_to_consume; ++i) {
+		assert(!blocking_queue_take(&bq, record));
+		consumed[i] = check_record(record);
+	}
+
+	free(record);
+	return 0;
+}
+
+static int compare_ints(const void* a, const void* b) {
+	return *(const int*)a - *(const int*)b;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 6) {
+		printf("usage: %s <num_producer_threads> <num_consumer_threads> <data_size> <capacity> <element_size>\n", argv[0]);
+		return -1;
+	}
+
+	num_producer_threads = atoi(argv[1]);
+	num_consumer_threads = atoi(argv[2]);
+	data_size = atoi(argv[3]);
+	unsigned int capacity = atoi(argv[4]);
+	element_size = atoi(argv[5]);
+	assert(data_size % num_producer_threads == 0);
+	assert(data_size % num_consumer_threads == 0);
+	assert(element_size >= sizeof(int));
+
+	consumed = malloc(data_size * sizeof(int));
+	producer_threads_ids = malloc(num_producer_threads * sizeof(int));
+	consumer_threads_ids = malloc(num_consumer_threads * sizeof(int));
+	producer_threads = malloc(num_producer_threads * sizeof(pthread_t));
+	consumer_threads = malloc(num_consumer_threads * sizeof(pthread_t));
+
+	assert(!blocking_queue_init_sized(&bq, capacity, element_size));
+
+	// Batched and non-blocking calls in a single thread, before the concurrent part
+	if (capacity == 0 || capacity >= 3) {
+		unsigned char* in = malloc(3 * element_size);
+		unsigned char* out = malloc(3 * element_size);
+		unsigned int count;
+		for (int i = 0; i < 3; ++i) {
+			fill_record(in + i * element_size, -i);
+		}
+		assert(!blocking_queue_add_n(&bq, (void**)in, 2, &count) && count == 2);
+		assert(!blocking_queue_add(&bq, in + 2 * element_size));
+		assert(!blocking_queue_poll(&bq, out));
+		assert(!blocking_queue_take_n(&bq, (void**)(out + element_size), 2, &count) && count == 2);
+		assert(!memcmp(in, out, 3 * element_size));
+		assert(blocking_queue_poll(&bq, out) == BQ_EMPTY);
+		free(in);
+		free(out);
+	}
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		producer_threads_ids[i] = i;
+		if (pthread_create(&producer_threads[i], NULL, producer, &producer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		consumer_threads_ids[i] = i;
+		if (pthread_create(&consumer_threads[i], NULL, consumer, &consumer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		pthread_join(producer_threads[i], NULL);
+	}
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		pthread_join(consumer_threads[i], NULL);
+	}
+
+	qsort(consumed, data_size, sizeof(int), compare_ints);
+
+	for (unsigned int i = 0; i < data_size; ++i) {
+		assert(consumed[i] == i);
+	}
+
+	blocking_queue_destroy(&bq);
+	free(consumed);
+	free(producer_threads_ids);
+	free(consumer_threads_ids);
+	free(producer_threads);
+	free(consumer_threads);
+
+	printf("Test completed succesfully. [%u, %u, %u, %u, %u]\n", num_producer_threads, num_consumer_threads, data_size, capacity,
+		element_size);
+	return 0;
+}
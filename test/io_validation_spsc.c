@@ -0,0 +1,106 @@
+#define C_FEK_SPSC_BLOCKING_QUEUE_IMPLEMENTATION
+#include "../spsc_blocking_queue.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static Spsc_Blocking_Queue bq;
+
+static int data_size;
+static int queue_capacity;
+
+static int* produced;
+static int* consumed;
+
+void* producer(void* args) {
+	for (unsigned int i = 0; i < data_size; ++i) {
+		// Mix blocking and non-blocking calls
+		if (i % 2) {
+			assert(!spsc_blocking_queue_put(&bq, &produced[i]));
+		} else {
+			int ret = spsc_blocking_queue_add(&bq, &produced[i]);
+			assert(ret == 0 || ret == BQ_FULL);
+			if (ret == BQ_FULL) {
+				assert(!spsc_blocking_queue_put(&bq, &produced[i]));
+			}
+		}
+	}
+
+	return 0;
+}
+
+void* consumer(void* args) {
+	for (unsigned int i = 0; i < data_size; ++i) {
+		void* got;
+		if (i % 3) {
+			assert(!spsc_blocking_queue_take(&bq, &got));
+		} else {
+			int ret = spsc_blocking_queue_poll(&bq, &got);
+			assert(ret == 0 || ret == BQ_EMPTY);
+			if (ret == BQ_EMPTY) {
+				assert(!spsc_blocking_queue_take(&bq, &got));
+			}
+		}
+		assert(got != NULL);
+		consumed[i] = *(int*)got;
+	}
+
+	// The queue is closed by the main thread while we are blocked
+	void* got;
+	assert(spsc_blocking_queue_take(&bq, &got) == BQ_CLOSED);
+
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 3) {
+		printf("usage: %s <queue_capacity> <data_size>\n", argv[0]);
+		return -1;
+	}
+
+	queue_capacity = atoi(argv[1]);
+	data_size = atoi(argv[2]);
+
+	produced = malloc(data_size * sizeof(int));
+	consumed = malloc(data_size * sizeof(int));
+
+	assert(!spsc_blocking_queue_init(&bq, queue_capacity));
+
+	for (unsigned int i = 0; i < data_size; ++i) {
+		produced[i] = i;
+	}
+
+	pthread_t producer_thread, consumer_thread;
+	if (pthread_create(&producer_thread, NULL, producer, NULL)) {
+		fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+		return -1;
+	}
+	if (pthread_create(&consumer_thread, NULL, consumer, NULL)) {
+		fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+		return -1;
+	}
+
+	pthread_join(producer_thread, NULL);
+	// Wait until the consumer drained the queue, so it ends up blocked in the last take
+	while (__atomic_load_n(&bq.head, __ATOMIC_ACQUIRE) != data_size);
+	spsc_blocking_queue_close(&bq);
+	pthread_join(consumer_thread, NULL);
+
+	// Single producer and single consumer: elements must come out in the exact order they were put
+	for (unsigned int i = 0; i < data_size; ++i) {
+		assert(produced[i] == consumed[i]);
+	}
+
+	void* got;
+	assert(spsc_blocking_queue_add(&bq, &produced[0]) == BQ_CLOSED);
+	assert(spsc_blocking_queue_poll(&bq, &got) == BQ_CLOSED);
+
+	spsc_blocking_queue_destroy(&bq);
+	free(produced);
+	free(consumed);
+
+	printf("Test completed succesfully. [%u, %u]\n", queue_capacity, data_size);
+	return 0;
+}
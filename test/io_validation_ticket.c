@@ -0,0 +1,234 @@
+#define C_FEK_TICKET_BLOCKING_QUEUE_IMPLEMENTATION
+#include "../ticket_blocking_queue.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+static Ticket_Blocking_Queue bq;
+
+static int data_size;
+static int num_producer_threads;
+static int num_consumer_threads;
+
+static int* produced;
+static int* consumed;
+
+static int* producer_threads_ids;
+static int* consumer_threads_ids;
+static pthread_t* producer_threads;
+static pthread_t* consumer_threads;
+
+#define BLOCKING_QUEUE_CAPACITY 2
+#define BLOCKED_CALLERS 8
+
+static void heapsort(int a[], int n) {
+	int i = n / 2, parent, child, t;
+	while (1) {
+		if (i > 0) {
+			i--;
+			t = a[i];
+		} else {
+			n--;
+			if (n <= 0) return;
+			t = a[n];
+			a[n] = a[0];
+		}
+		parent = i;
+		child = i * 2 + 1;
+		while (child < n) {
+			if ((child + 1 < n) && (a[child + 1] > a[child]))
+				child++;
+			if (a[child] > t) {
+				a[parent] = a[child];
+				parent = child;
+				child = parent * 2 + 1;
+			} else {
+				break;
+			}
+		}
+		a[parent] = t;
+	}
+}
+
+void* producer(void* args) {
+	int producer_id = *(int*)args;
+	unsigned int num_data_to_consume = data_size / num_producer_threads;
+	unsigned int start_at = producer_id * num_data_to_consume;
+
+	for (unsigned int i = start_at; i < start_at + num_data_to_consume; ++i) {
+		// Mix blocking and non-blocking calls
+		if (i % 2) {
+			assert(!ticket_blocking_queue_put(&bq, &produced[i]));
+		} else {
+			int ret = ticket_blocking_queue_add(&bq, &produced[i]);
+			assert(ret == 0 || ret == BQ_FULL);
+			if (ret == BQ_FULL) {
+				assert(!ticket_blocking_queue_put(&bq, &produced[i]));
+			}
+		}
+	}
+
+	return 0;
+}
+
+void* consumer(void* args) {
+	int consumer_id = *(int*)args;
+	unsigned int num_data_to_consume = data_size / num_consumer_threads;
+	unsigned int start_at = consumer_id * num_data_to_consume;
+
+	for (unsigned int i = start_at; i < start_at + num_data_to_consume; ++i) {
+		void* got;
+		if (i % 3) {
+			assert(!ticket_blocking_queue_take(&bq, &got));
+		} else {
+			int ret = ticket_blocking_queue_poll(&bq, &got);
+			assert(ret == 0 || ret == BQ_EMPTY);
+			if (ret == BQ_EMPTY) {
+				assert(!ticket_blocking_queue_take(&bq, &got));
+			}
+		}
+		assert(got != NULL);
+		consumed[i] = *(int*)got;
+	}
+
+	return 0;
+}
+
+static Ticket_Blocking_Queue blocked_bq;
+
+static unsigned int get_parked_callers() {
+	unsigned int parked = 0;
+	for (unsigned int i = 0; i < blocked_bq.queue_capacity; ++i) {
+		parked += __atomic_load_n(&blocked_bq.slots[i].waiters, __ATOMIC_SEQ_CST);
+	}
+	return parked;
+}
+
+static void* blocked_putter(void* args) {
+	return (void*)(long)ticket_blocking_queue_put(&blocked_bq, args);
+}
+
+static void* blocked_taker(void* args) {
+	void* got;
+	return (void*)(long)ticket_blocking_queue_take(&blocked_bq, &got);
+}
+
+// Closes a queue while callers are parked both waiting for space and for elements (on different slots and laps): they must all
+// have left by the time close returns, so the queue can be destroyed right away.
+static void check_close_with_blocked_callers() {
+	pthread_t putters[BLOCKED_CALLERS];
+	pthread_t takers[BLOCKED_CALLERS];
+
+	// Takers park on an empty queue
+	assert(!ticket_blocking_queue_init(&blocked_bq, BLOCKING_QUEUE_CAPACITY));
+	for (int i = 0; i < BLOCKED_CALLERS; ++i) {
+		assert(!pthread_create(&takers[i], NULL, blocked_taker, NULL));
+	}
+	while (get_parked_callers() != BLOCKED_CALLERS) {
+		usleep(100);
+	}
+	ticket_blocking_queue_close(&blocked_bq);
+	assert(get_parked_callers() == 0);
+	assert(__atomic_load_n(&blocked_bq.active_callers, __ATOMIC_SEQ_CST) == TICKET_BLOCKING_QUEUE_CALLERS_CLOSED);
+	ticket_blocking_queue_destroy(&blocked_bq);
+	for (int i = 0; i < BLOCKED_CALLERS; ++i) {
+		void* ret;
+		pthread_join(takers[i], &ret);
+		assert((long)ret == BQ_CLOSED);
+	}
+
+	// Putters park on a full queue, and destroy closes it by itself
+	assert(!ticket_blocking_queue_init(&blocked_bq, BLOCKING_QUEUE_CAPACITY));
+	for (int i = 0; i < BLOCKING_QUEUE_CAPACITY; ++i) {
+		assert(!ticket_blocking_queue_add(&blocked_bq, &blocked_bq));
+	}
+	for (int i = 0; i < BLOCKED_CALLERS; ++i) {
+		assert(!pthread_create(&putters[i], NULL, blocked_putter, &blocked_bq));
+	}
+	while (get_parked_callers() != BLOCKED_CALLERS) {
+		usleep(100);
+	}
+	ticket_blocking_queue_destroy(&blocked_bq);
+	for (int i = 0; i < BLOCKED_CALLERS; ++i) {
+		void* ret;
+		pthread_join(putters[i], &ret);
+		assert((long)ret == BQ_CLOSED);
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc != 4) {
+		printf("usage: %s <num_producer_threads> <num_consumer_threads> <data_size>\n", argv[0]);
+		return -1;
+	}
+
+	num_producer_threads = atoi(argv[1]);
+	num_consumer_threads = atoi(argv[2]);
+	data_size = atoi(argv[3]);
+	assert(data_size % num_producer_threads == 0);
+	assert(data_size % num_consumer_threads == 0);
+
+	produced = malloc(data_size * sizeof(int));
+	consumed = malloc(data_size * sizeof(int));
+	producer_threads_ids = malloc(num_producer_threads * sizeof(int));
+	consumer_threads_ids = malloc(num_consumer_threads * sizeof(int));
+	producer_threads = malloc(num_producer_threads * sizeof(pthread_t));
+	consumer_threads = malloc(num_consumer_threads * sizeof(pthread_t));
+
+	assert(!ticket_blocking_queue_init(&bq, BLOCKING_QUEUE_CAPACITY));
+
+	for (unsigned int i = 0; i < data_size; ++i) {
+		produced[i] = i;
+	}
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		producer_threads_ids[i] = i;
+		if (pthread_create(&producer_threads[i], NULL, producer, &producer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		consumer_threads_ids[i] = i;
+		if (pthread_create(&consumer_threads[i], NULL, consumer, &consumer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		pthread_join(producer_threads[i], NULL);
+	}
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		pthread_join(consumer_threads[i], NULL);
+	}
+
+	heapsort(consumed, data_size);
+
+	for (unsigned int i = 0; i < data_size; ++i) {
+		assert(produced[i] == consumed[i]);
+	}
+
+	void* got;
+	assert(ticket_blocking_queue_poll(&bq, &got) == BQ_EMPTY);
+	ticket_blocking_queue_close(&bq);
+	assert(ticket_blocking_queue_add(&bq, &produced[0]) == BQ_CLOSED);
+	assert(ticket_blocking_queue_take(&bq, &got) == BQ_CLOSED);
+
+	ticket_blocking_queue_destroy(&bq);
+	check_close_with_blocked_callers();
+	free(produced);
+	free(consumed);
+	free(producer_threads_ids);
+	free(consumer_threads_ids);
+	free(producer_threads);
+	free(consumer_threads);
+
+	printf("Test completed succesfully. [%u, %u, %u]\n", num_producer_threads, num_consumer_threads, data_size);
+	return 0;
+}
\ No newline at end of file
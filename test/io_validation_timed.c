@@ -0,0 +1,190 @@
+#define C_FEK_BLOCKING_QUEUE_IMPLEMENTATION
+#define C_FEK_FAIR_LOCK_IMPLEMENTATION
+#include "../blocking_queue.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <limits.h>
+
+// Takers queue one after the other on an empty queue: the first one holds the 'get_lock' waiting for elements, and the others wait
+// for their turn. Depending on the round, every other taker uses a timeout: all of them must time out (no earlier than their
+// timeout) while still waiting for their turn, and the remaining takers must then get the elements in the order they arrived.
+
+typedef struct {
+	int id;
+	int timed;
+} Taker;
+
+static Blocking_Queue bq;
+
+static int num_threads;
+static int rounds;
+static unsigned long long timeout_ns;
+
+static Taker* takers;
+static int* results;
+static long* taken;
+static unsigned long long* elapsed_ns;
+
+static pthread_t* threads;
+
+void* taker(void* args) {
+	Taker* t = args;
+	void* element = NULL;
+	unsigned long long start = fair_lock_now_ns();
+	results[t->id] = t->timed ? blocking_queue_take_timed(&bq, &element, timeout_ns) : blocking_queue_take(&bq, &element);
+	elapsed_ns[t->id] = fair_lock_now_ns() - start;
+	taken[t->id] = (long)element;
+	return 0;
+}
+
+static unsigned long long get_next_ticket() {
+	pthread_mutex_lock(&bq.get_lock.mutex);
+	unsigned long long ticket = bq.get_lock.next_ticket;
+	pthread_mutex_unlock(&bq.get_lock.mutex);
+	return ticket;
+}
+
+static unsigned int get_not_empty_waiters() {
+	pthread_mutex_lock(&bq.mutex);
+	unsigned int waiters = bq.not_empty_waiters;
+	pthread_mutex_unlock(&bq.mutex);
+	return waiters;
+}
+
+static void* put_after_delay(void* args) {
+	usleep(10000);
+	assert(!blocking_queue_put(args, args));
+	return 0;
+}
+
+// Timeouts and deadlines without contention for the turn
+static void check_deadlines() {
+	Blocking_Queue q;
+	void* element;
+	assert(!blocking_queue_init(&q, 1));
+
+	// Waiting for an element/for space
+	unsigned long long start = fair_lock_now_ns();
+	assert(blocking_queue_take_timed(&q, &element, 5000000) == BQ_TIMEOUT);
+	assert(fair_lock_now_ns() - start >= 5000000);
+	assert(blocking_queue_take_until(&q, &element, fair_lock_now_ns()) == BQ_TIMEOUT);
+	assert(!blocking_queue_put_timed(&q, &q, 5000000));
+	start = fair_lock_now_ns();
+	assert(blocking_queue_put_timed(&q, &q, 5000000) == BQ_TIMEOUT);
+	assert(fair_lock_now_ns() - start >= 5000000);
+	assert(blocking_queue_put_until(&q, &q, 0) == BQ_TIMEOUT);
+
+	// An expired deadline does not matter if the call does not have to wait
+	assert(!blocking_queue_take_until(&q, &element, 0) && element == &q);
+	assert(!blocking_queue_put_until(&q, &q, fair_lock_now_ns()));
+	assert(!blocking_queue_take_timed(&q, &element, 0) && element == &q);
+
+	// Waiting for the turn
+	assert(!fair_lock_lock(&q.add_lock));
+	start = fair_lock_now_ns();
+	assert(blocking_queue_put_timed(&q, &q, 5000000) == BQ_TIMEOUT);
+	assert(fair_lock_now_ns() - start >= 5000000);
+	assert(q.add_lock.waiting_threads == 0);
+	fair_lock_unlock(&q.add_lock);
+	assert(!blocking_queue_put_timed(&q, &q, 5000000));
+
+	// Timeouts too large for a deadline mean waiting forever
+	pthread_t thread;
+	assert(!blocking_queue_take_timed(&q, &element, 0) && element == &q);
+	assert(!pthread_create(&thread, NULL, put_after_delay, &q));
+	assert(!blocking_queue_take_timed(&q, &element, ULLONG_MAX) && element == &q);
+	pthread_join(thread, NULL);
+	assert(!blocking_queue_put_timed(&q, &q, ULLONG_MAX));
+	assert(blocking_queue_deadline_after(ULLONG_MAX) == 0);
+	assert(blocking_queue_deadline_after(ULLONG_MAX - fair_lock_now_ns() + 1) == 0);
+
+	blocking_queue_close(&q);
+	assert(blocking_queue_take_timed(&q, &element, 5000000) == BQ_CLOSED);
+	blocking_queue_destroy(&q);
+}
+
+int main(int argc, char** argv) {
+	if (argc != 4) {
+		printf("usage: %s <num_threads> <rounds> <timeout_ms>\n", argv[0]);
+		return -1;
+	}
+
+	num_threads = atoi(argv[1]);
+	rounds = atoi(argv[2]);
+	timeout_ns = strtoull(argv[3], NULL, 10) * 1000000ull;
+
+	takers = malloc(num_threads * sizeof(Taker));
+	results = malloc(num_threads * sizeof(int));
+	taken = malloc(num_threads * sizeof(long));
+	elapsed_ns = malloc(num_threads * sizeof(unsigned long long));
+	threads = malloc(num_threads * sizeof(pthread_t));
+
+	check_deadlines();
+	assert(!blocking_queue_init(&bq, num_threads));
+
+	for (int r = 0; r < rounds; ++r) {
+		unsigned long long first_ticket = get_next_ticket();
+		int num_untimed = 0;
+
+		for (int i = 0; i < num_threads; ++i) {
+			takers[i].id = i;
+			// The first taker holds the 'get_lock', so the others have to wait for their turn
+			takers[i].timed = i > 0 && (i + r) % 2;
+			num_untimed += !takers[i].timed;
+			results[i] = -1;
+			if (pthread_create(&threads[i], NULL, taker, &takers[i])) {
+				fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+				return -1;
+			}
+			if (i == 0) {
+				while (get_not_empty_waiters() != 1) {
+					usleep(100);
+				}
+			} else {
+				// Tickets are never given back, so this works even if timed takers already left
+				while (get_next_ticket() != first_ticket + i) {
+					usleep(100);
+				}
+			}
+		}
+
+		for (int i = 0; i < num_threads; ++i) {
+			if (takers[i].timed) {
+				pthread_join(threads[i], NULL);
+				assert(results[i] == BQ_TIMEOUT);
+				assert(elapsed_ns[i] >= timeout_ns);
+			}
+		}
+		pthread_mutex_lock(&bq.get_lock.mutex);
+		assert(bq.get_lock.waiting_threads == num_untimed - 1);
+		pthread_mutex_unlock(&bq.get_lock.mutex);
+
+		for (long i = 0; i < num_untimed; ++i) {
+			assert(!blocking_queue_put(&bq, (void*)i));
+		}
+
+		// FIFO order among the takers that did not time out
+		long expected = 0;
+		for (int i = 0; i < num_threads; ++i) {
+			if (!takers[i].timed) {
+				pthread_join(threads[i], NULL);
+				assert(results[i] == 0);
+				assert(taken[i] == expected++);
+			}
+		}
+	}
+
+	blocking_queue_destroy(&bq);
+	free(takers);
+	free(results);
+	free(taken);
+	free(elapsed_ns);
+	free(threads);
+
+	printf("Test completed succesfully. [%u, %u, %s]\n", num_threads, rounds, argv[3]);
+	return 0;
+}
@@ -0,0 +1,181 @@
+#define C_FEK_BLOCKING_QUEUE_IMPLEMENTATION
+#define C_FEK_FAIR_LOCK_IMPLEMENTATION
+#include "../blocking_queue.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sched.h>
+
+typedef struct {
+	int value;
+	int producer_id;
+	unsigned int sequence;
+	char payload[20];
+} Record;
+
+BQ_DEFINE(record, Record)
+
+static record_queue q;
+
+static int data_size;
+static int num_producer_threads;
+static int num_consumer_threads;
+
+static int* consumed;
+
+static int* producer_threads_ids;
+static int* consumer_threads_ids;
+static pthread_t* producer_threads;
+static pthread_t* consumer_threads;
+
+static void fill_payload(Record* r) {
+	for (unsigned int i = 0; i < sizeof(r->payload); ++i) {
+		r->payload[i] = (char)(r->value + i);
+	}
+}
+
+static void check_payload(const Record* r) {
+	for (unsigned int i = 0; i < sizeof(r->payload); ++i) {
+		assert(r->payload[i] == (char)(r->value + i));
+	}
+}
+
+void* producer(void* args) {
+	int producer_id = *(int*)args;
+	unsigned int num_data_to_produce = data_size / num_producer_threads;
+	unsigned int start_at = producer_id * num_data_to_produce;
+
+	for (unsigned int i = 0; i < num_data_to_produce; ++i) {
+		Record r;
+		r.value = start_at + i;
+		r.producer_id = producer_id;
+		r.sequence = i;
+		fill_payload(&r);
+		if (i % 2) {
+			assert(!record_queue_put(&q, r));
+		} else {
+			int ret;
+			while ((ret = record_queue_add(&q, r)) == BQ_FULL) {
+				sched_yield();
+			}
+			assert(ret == 0);
+		}
+	}
+
+	return 0;
+}
+
+void* consumer(void* args) {
+	int consumer_id = *(int*)args;
+	unsigned int num_data_to_consume = data_size / num_consumer_threads;
+	unsigned int start_at = consumer_id * num_data_to_consume;
+	// Since the queue is FIFO, the elements of each producer must be seen in order
+	unsigned int* next_sequence = calloc(num_producer_threads, sizeof(unsigned int));
+
+	for (unsigned int i = start_at; i < start_at + num_data_to_consume; ++i) {
+		Record r;
+		if (i % 2) {
+			assert(!record_queue_take(&q, &r));
+		} else {
+			int ret;
+			while ((ret = record_queue_poll(&q, &r)) == BQ_EMPTY) {
+				sched_yield();
+			}
+			assert(ret == 0);
+		}
+		check_payload(&r);
+		assert(r.sequence >= next_sequence[r.producer_id]);
+		next_sequence[r.producer_id] = r.sequence + 1;
+		consumed[i] = r.value;
+	}
+
+	free(next_sequence);
+	return 0;
+}
+
+static int compare_ints(const void* a, const void* b) {
+	return *(const int*)a - *(const int*)b;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 5 && argc != 6) {
+		printf("usage: %s <num_producer_threads> <num_consumer_threads> <data_size> <capacity> [power_of_two_capacity]\n", argv[0]);
+		return -1;
+	}
+
+	num_producer_threads = atoi(argv[1]);
+	num_consumer_threads = atoi(argv[2]);
+	data_size = atoi(argv[3]);
+	unsigned int capacity = atoi(argv[4]);
+	assert(data_size % num_producer_threads == 0);
+	assert(data_size % num_consumer_threads == 0);
+
+	consumed = malloc(data_size * sizeof(int));
+	producer_threads_ids = malloc(num_producer_threads * sizeof(int));
+	consumer_threads_ids = malloc(num_consumer_threads * sizeof(int));
+	producer_threads = malloc(num_producer_threads * sizeof(pthread_t));
+	consumer_threads = malloc(num_consumer_threads * sizeof(pthread_t));
+
+	Blocking_Queue_Options options = {0};
+	options.power_of_two_capacity = argc == 6 && atoi(argv[5]);
+	assert(!record_queue_init_with_options(&q, capacity, &options));
+
+	// Batched calls in a single thread, before the concurrent part
+	if (capacity == 0 || capacity >= 3) {
+		Record in[3], out[3];
+		unsigned int count;
+		for (int i = 0; i < 3; ++i) {
+			in[i].value = -i;
+			fill_payload(&in[i]);
+		}
+		assert(!record_queue_put_n(&q, in, 3, &count) && count == 3);
+		assert(!record_queue_take_n(&q, out, 3, &count) && count == 3);
+		assert(!memcmp(in, out, sizeof(in)));
+		assert(record_queue_poll_n(&q, out, 3, &count) == BQ_EMPTY && count == 0);
+	}
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		producer_threads_ids[i] = i;
+		if (pthread_create(&producer_threads[i], NULL, producer, &producer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		consumer_threads_ids[i] = i;
+		if (pthread_create(&consumer_threads[i], NULL, consumer, &consumer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		pthread_join(producer_threads[i], NULL);
+	}
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		pthread_join(consumer_threads[i], NULL);
+	}
+
+	qsort(consumed, data_size, sizeof(int), compare_ints);
+
+	for (unsigned int i = 0; i < data_size; ++i) {
+		assert(consumed[i] == i);
+	}
+
+	record_queue_close(&q);
+	Record r;
+	assert(record_queue_take(&q, &r) == BQ_CLOSED);
+	record_queue_destroy(&q);
+	free(consumed);
+	free(producer_threads_ids);
+	free(consumer_threads_ids);
+	free(producer_threads);
+	free(consumer_threads);
+
+	printf("Test completed succesfully. [%u, %u, %u, %u]\n", num_producer_threads, num_consumer_threads, data_size, capacity);
+	return 0;
+}
@@ -0,0 +1,154 @@
+#define C_FEK_FAIR_LOCK_IMPLEMENTATION
+#include "../fair_lock.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+// Weak and strong callers queue behind the main thread, which holds the lock. Depending on the round, the main thread either
+// unlocks (all of them must get the lock in the order they arrived) or blocks weak locks first (every weak caller must give up
+// while the lock is still held, and the strong ones must then get the lock in the order they arrived).
+// At the end, the lock is closed with callers waiting: all of them, weak and strong, must give up while the lock is still held.
+
+typedef struct {
+	int id;
+	int weak;
+} Waiter;
+
+static Fair_Lock lock;
+
+static int num_threads;
+static int rounds;
+
+static Waiter* waiters;
+static int* results;
+static int* order;
+static int order_position;
+
+static pthread_t* threads;
+
+void* waiter(void* args) {
+	Waiter* w = args;
+	int ret = w->weak ? fair_lock_lock_weak(&lock) : fair_lock_lock(&lock);
+	results[w->id] = ret;
+	if (ret == 0) {
+		order[order_position++] = w->id;
+		fair_lock_unlock(&lock);
+	}
+	return 0;
+}
+
+static int get_waiting_threads() {
+	pthread_mutex_lock(&lock.mutex);
+	int count = lock.waiting_threads;
+	pthread_mutex_unlock(&lock.mutex);
+	return count;
+}
+
+static void wait_for_waiting_threads(int count) {
+	while (get_waiting_threads() != count) {
+		usleep(100);
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc != 3) {
+		printf("usage: %s <num_threads> <rounds>\n", argv[0]);
+		return -1;
+	}
+
+	num_threads = atoi(argv[1]);
+	rounds = atoi(argv[2]);
+
+	waiters = malloc(num_threads * sizeof(Waiter));
+	results = malloc(num_threads * sizeof(int));
+	order = malloc(num_threads * sizeof(int));
+	threads = malloc(num_threads * sizeof(pthread_t));
+
+	assert(!fair_lock_init(&lock));
+
+	for (int r = 0; r < rounds; ++r) {
+		int abandon = r % 2;
+		int num_strong = 0;
+		order_position = 0;
+
+		assert(!fair_lock_lock(&lock));
+		for (int i = 0; i < num_threads; ++i) {
+			waiters[i].id = i;
+			waiters[i].weak = (i + r) % 3 == 1;
+			num_strong += !waiters[i].weak;
+			results[i] = -1;
+			if (pthread_create(&threads[i], NULL, waiter, &waiters[i])) {
+				fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+				return -1;
+			}
+			wait_for_waiting_threads(i + 1);
+		}
+
+		if (abandon) {
+			fair_lock_block_weak_locks(&lock);
+			// Weak callers give up while the lock is still held
+			for (int i = 0; i < num_threads; ++i) {
+				if (waiters[i].weak) {
+					pthread_join(threads[i], NULL);
+					assert(results[i] == FL_ABANDONED);
+				}
+			}
+			assert(get_waiting_threads() == num_strong);
+			assert(fair_lock_lock_weak(&lock) == FL_ABANDONED);
+		}
+
+		fair_lock_unlock(&lock);
+		for (int i = 0; i < num_threads; ++i) {
+			if (!abandon || !waiters[i].weak) {
+				pthread_join(threads[i], NULL);
+				assert(results[i] == 0);
+			}
+		}
+
+		// FIFO order, weak and strong callers alike
+		assert(order_position == (abandon ? num_strong : num_threads));
+		for (int i = 1; i < order_position; ++i) {
+			assert(order[i - 1] < order[i]);
+		}
+
+		if (abandon) {
+			fair_lock_allow_weak_locks(&lock);
+		}
+		assert(!fair_lock_lock_weak(&lock));
+		fair_lock_unlock(&lock);
+	}
+
+	assert(!fair_lock_lock(&lock));
+	for (int i = 0; i < num_threads; ++i) {
+		waiters[i].weak = i % 2;
+		results[i] = -1;
+		if (pthread_create(&threads[i], NULL, waiter, &waiters[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+		wait_for_waiting_threads(i + 1);
+	}
+	fair_lock_close(&lock);
+	for (int i = 0; i < num_threads; ++i) {
+		pthread_join(threads[i], NULL);
+		assert(results[i] == FL_ABANDONED);
+	}
+	assert(get_waiting_threads() == 0);
+	assert(fair_lock_lock(&lock) == FL_ABANDONED);
+	fair_lock_unlock(&lock);
+	// A closed lock can still be taken when it is free
+	assert(!fair_lock_lock(&lock));
+	fair_lock_unlock(&lock);
+
+	fair_lock_destroy(&lock);
+	free(waiters);
+	free(results);
+	free(order);
+	free(threads);
+
+	printf("Test completed succesfully. [%u, %u]\n", num_threads, rounds);
+	return 0;
+}
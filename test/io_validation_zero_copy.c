@@ -0,0 +1,183 @@
+#define C_FEK_BLOCKING_QUEUE_IMPLEMENTATION
+#define C_FEK_FAIR_LOCK_IMPLEMENTATION
+#include "../blocking_queue.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Records are 'element_size' bytes: an int with the value, followed by bytes derived from it.
+// Half of the records are written/read in place (reserve/commit and acquire/release), the other half are copied (put/take).
+
+static Blocking_Queue bq;
+
+static int data_size;
+static int num_producer_threads;
+static int num_consumer_threads;
+static unsigned int element_size;
+
+static int* consumed;
+
+static int* producer_threads_ids;
+static int* consumer_threads_ids;
+static pthread_t* producer_threads;
+static pthread_t* consumer_threads;
+
+static void fill_record(unsigned char* record, int value) {
+	memcpy(record, &value, sizeof(int));
+	for (unsigned int i = sizeof(int); i < element_size; ++i) {
+		record[i] = (unsigned char)(value * 31 + i);
+	}
+}
+
+static int check_record(const unsigned char* record) {
+	int value;
+	memcpy(&value, record, sizeof(int));
+	for (unsigned int i = sizeof(int); i < element_size; ++i) {
+		assert(record[i] == (unsigned char)(value * 31 + i));
+	}
+	return value;
+}
+
+void* producer(void* args) {
+	int producer_id = *(int*)args;
+	unsigned int num_data_to_produce = data_size / num_producer_threads;
+	unsigned int start_at = producer_id * num_data_to_produce;
+	unsigned char* record = malloc(element_size);
+
+	for (unsigned int i = start_at; i < start_at + num_data_to_produce; ++i) {
+		if (i % 2) {
+			fill_record(record, i);
+			assert(!blocking_queue_put(&bq, record));
+		} else {
+			void* slot;
+			assert(!blocking_queue_reserve_put(&bq, &slot));
+			fill_record(slot, i);
+			blocking_queue_commit_put(&bq);
+		}
+	}
+
+	free(record);
+	return 0;
+}
+
+void* consumer(void* args) {
+	int consumer_id = *(int*)args;
+	unsigned int num_data_to_consume = data_size / num_consumer_threads;
+	unsigned int start_at = consumer_id * num_data_to_consume;
+	unsigned char* record = malloc(element_size);
+
+	for (unsigned int i = start_at; i < start_at + num_data_to_consume; ++i) {
+		if (i % 2) {
+			assert(!blocking_queue_take(&bq, record));
+			consumed[i] = check_record(record);
+		} else {
+			void* slot;
+			assert(!blocking_queue_acquire_take(&bq, &slot));
+			consumed[i] = check_record(slot);
+			blocking_queue_release_take(&bq);
+		}
+	}
+
+	free(record);
+	return 0;
+}
+
+static int compare_ints(const void* a, const void* b) {
+	return *(const int*)a - *(const int*)b;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 6) {
+		printf("usage: %s <num_producer_threads> <num_consumer_threads> <data_size> <capacity> <element_size>\n", argv[0]);
+		return -1;
+	}
+
+	num_producer_threads = atoi(argv[1]);
+	num_consumer_threads = atoi(argv[2]);
+	data_size = atoi(argv[3]);
+	unsigned int capacity = atoi(argv[4]);
+	element_size = atoi(argv[5]);
+	assert(data_size % num_producer_threads == 0);
+	assert(data_size % num_consumer_threads == 0);
+	assert(element_size >= sizeof(int));
+
+	consumed = malloc(data_size * sizeof(int));
+	producer_threads_ids = malloc(num_producer_threads * sizeof(int));
+	consumer_threads_ids = malloc(num_consumer_threads * sizeof(int));
+	producer_threads = malloc(num_producer_threads * sizeof(pthread_t));
+	consumer_threads = malloc(num_consumer_threads * sizeof(pthread_t));
+
+	assert(!blocking_queue_init_sized(&bq, capacity, element_size));
+
+	// In a single thread, before the concurrent part: in-place calls interleaved with copies
+	{
+		unsigned char* record = malloc(element_size);
+		void* acquired;
+		void* slot;
+		fill_record(record, -1);
+		assert(!blocking_queue_put(&bq, record));
+		assert(!blocking_queue_acquire_take(&bq, &acquired));
+		// Fills the queue. A boundless queue grows meanwhile: the acquired slot must stay readable until it is released
+		unsigned int n = capacity == 0 ? 64 : capacity - 1;
+		for (unsigned int i = 0; i < n; ++i) {
+			assert(!blocking_queue_reserve_put(&bq, &slot));
+			fill_record(slot, -2 - (int)i);
+			blocking_queue_commit_put(&bq);
+		}
+		assert(check_record(acquired) == -1);
+		blocking_queue_release_take(&bq);
+		for (unsigned int i = 0; i < n; ++i) {
+			assert(!blocking_queue_take(&bq, record));
+			assert(check_record(record) == -2 - (int)i);
+		}
+		assert(blocking_queue_poll(&bq, record) == BQ_EMPTY);
+		free(record);
+	}
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		producer_threads_ids[i] = i;
+		if (pthread_create(&producer_threads[i], NULL, producer, &producer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		consumer_threads_ids[i] = i;
+		if (pthread_create(&consumer_threads[i], NULL, consumer, &consumer_threads_ids[i])) {
+			fprintf(stderr, "error creating thread: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_producer_threads; ++i) {
+		pthread_join(producer_threads[i], NULL);
+	}
+
+	for (unsigned int i = 0; i < num_consumer_threads; ++i) {
+		pthread_join(consumer_threads[i], NULL);
+	}
+
+	qsort(consumed, data_size, sizeof(int), compare_ints);
+
+	for (unsigned int i = 0; i < data_size; ++i) {
+		assert(consumed[i] == i);
+	}
+
+	blocking_queue_close(&bq);
+	void* slot;
+	assert(blocking_queue_reserve_put(&bq, &slot) == BQ_CLOSED && slot == NULL);
+	assert(blocking_queue_acquire_take(&bq, &slot) == BQ_CLOSED && slot == NULL);
+	blocking_queue_destroy(&bq);
+	free(consumed);
+	free(producer_threads_ids);
+	free(consumer_threads_ids);
+	free(producer_threads);
+	free(consumer_threads);
+
+	printf("Test completed succesfully. [%u, %u, %u, %u, %u]\n", num_producer_threads, num_consumer_threads, data_size, capacity,
+		element_size);
+	return 0;
+}
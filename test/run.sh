@@ -8,6 +8,28 @@ gcc -o $BIN_DIR/io_validation_boundless io_validation_boundless.c -lpthread -Wal
 gcc -o $BIN_DIR/io_validation_spin_lock io_validation_spin_lock.c -lpthread -Wall -g
 gcc -o $BIN_DIR/io_validation_destroy io_validation_destroy.c -lpthread -Wall -g
 gcc -o $BIN_DIR/io_validation_fifo io_validation_fifo.c -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_no_futex io_validation.c -DC_FEK_FAIR_LOCK_NO_FUTEX -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_fifo_no_futex io_validation_fifo.c -DC_FEK_FAIR_LOCK_NO_FUTEX -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_weak_locks io_validation_weak_locks.c -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_weak_locks_no_futex io_validation_weak_locks.c -DC_FEK_FAIR_LOCK_NO_FUTEX -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_timed io_validation_timed.c -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_timed_no_futex io_validation_timed.c -DC_FEK_FAIR_LOCK_NO_FUTEX -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_spin_policy io_validation.c -DTEST_SPIN_POLICY -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_spin_policy_no_futex io_validation.c -DTEST_SPIN_POLICY -DC_FEK_FAIR_LOCK_NO_FUTEX -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_stats io_validation.c -DTEST_STATS -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_cache_aligned io_validation.c -DC_FEK_BLOCKING_QUEUE_CACHE_LINE_SIZE=64 -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_typed io_validation_typed.c -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_sized io_validation_sized.c -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_zero_copy io_validation_zero_copy.c -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_allocator io_validation_allocator.c -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_no_alloc io_validation_no_alloc.c -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_no_alloc_no_futex io_validation_no_alloc.c -DC_FEK_FAIR_LOCK_NO_FUTEX -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_batch io_validation_batch.c -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_spsc io_validation_spsc.c -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_spsc_no_membarrier io_validation_spsc.c -DC_FEK_SPSC_BLOCKING_QUEUE_NO_MEMBARRIER -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_mpmc io_validation_mpmc.c -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_ticket io_validation_ticket.c -lpthread -Wall -g
+gcc -o $BIN_DIR/io_validation_ticket_fifo io_validation_ticket_fifo.c -lpthread -Wall -g
 ./$BIN_DIR/io_validation 1 1 16
 ./$BIN_DIR/io_validation 4 4 256
 ./$BIN_DIR/io_validation 128 128 131072
@@ -25,6 +47,9 @@ gcc -o $BIN_DIR/io_validation_fifo io_validation_fifo.c -lpthread -Wall -g
 ./$BIN_DIR/io_validation_boundless 32 128 131072
 ./$BIN_DIR/io_validation_boundless 128 32 131072
 ./$BIN_DIR/io_validation_boundless 1 128 131072
+./$BIN_DIR/io_validation_boundless 1 1 4096 1
+./$BIN_DIR/io_validation_boundless 16 16 131072 3
+./$BIN_DIR/io_validation_boundless 128 4 131072 64
 ./$BIN_DIR/io_validation_boundless 128 1 131072
 ./$BIN_DIR/io_validation_boundless 1024 1 1048576
 ./$BIN_DIR/io_validation_spin_lock 1 1 16
@@ -52,4 +77,103 @@ gcc -o $BIN_DIR/io_validation_fifo io_validation_fifo.c -lpthread -Wall -g
 ./$BIN_DIR/io_validation_fifo 8 8
 ./$BIN_DIR/io_validation_fifo 16 16
 ./$BIN_DIR/io_validation_fifo 32 32
+./$BIN_DIR/io_validation_no_futex 4 4 256
+./$BIN_DIR/io_validation_no_futex 128 128 131072
+./$BIN_DIR/io_validation_no_futex 1 128 131072
+./$BIN_DIR/io_validation_no_futex 128 1 131072
+./$BIN_DIR/io_validation_fifo_no_futex 8 8
+./$BIN_DIR/io_validation_weak_locks 2 4
+./$BIN_DIR/io_validation_weak_locks 16 8
+./$BIN_DIR/io_validation_weak_locks 256 4
+./$BIN_DIR/io_validation_weak_locks_no_futex 16 8
+./$BIN_DIR/io_validation_weak_locks_no_futex 256 4
+./$BIN_DIR/io_validation_timed 2 2 10
+./$BIN_DIR/io_validation_timed 16 4 50
+./$BIN_DIR/io_validation_timed 256 2 200
+./$BIN_DIR/io_validation_timed_no_futex 16 4 50
+./$BIN_DIR/io_validation_timed_no_futex 256 2 200
+./$BIN_DIR/io_validation_spin_policy 1 1 16
+./$BIN_DIR/io_validation_spin_policy 4 4 256
+./$BIN_DIR/io_validation_spin_policy 128 128 131072
+./$BIN_DIR/io_validation_spin_policy 1 128 131072
+./$BIN_DIR/io_validation_spin_policy 128 1 131072
+./$BIN_DIR/io_validation_spin_policy_no_futex 4 4 256
+./$BIN_DIR/io_validation_spin_policy_no_futex 128 128 131072
+./$BIN_DIR/io_validation_stats 1 1 16
+./$BIN_DIR/io_validation_stats 4 4 256
+./$BIN_DIR/io_validation_stats 128 128 131072
+./$BIN_DIR/io_validation_stats 1 128 131072
+./$BIN_DIR/io_validation_stats 128 1 131072
+./$BIN_DIR/io_validation_cache_aligned 1 1 16
+./$BIN_DIR/io_validation_cache_aligned 4 4 256
+./$BIN_DIR/io_validation_cache_aligned 128 128 131072
+./$BIN_DIR/io_validation_cache_aligned 128 1 131072
+./$BIN_DIR/io_validation_batch 1 1 16 1
+./$BIN_DIR/io_validation_batch 1 1 256 16
+./$BIN_DIR/io_validation_batch 4 4 4096 64
+./$BIN_DIR/io_validation_batch 128 128 131072 1024
+./$BIN_DIR/io_validation_batch 32 128 131072 8
+./$BIN_DIR/io_validation_batch 128 32 131072 8
+./$BIN_DIR/io_validation_batch 1 128 131072 2
+./$BIN_DIR/io_validation_batch 128 1 131072 2
+./$BIN_DIR/io_validation_spsc 1 16
+./$BIN_DIR/io_validation_spsc 2 131072
+./$BIN_DIR/io_validation_spsc 5 1048576
+./$BIN_DIR/io_validation_spsc 1024 1048576
+./$BIN_DIR/io_validation_spsc_no_membarrier 2 131072
+./$BIN_DIR/io_validation_spsc_no_membarrier 1024 1048576
+./$BIN_DIR/io_validation_mpmc 1 1 16
+./$BIN_DIR/io_validation_mpmc 4 4 256
+./$BIN_DIR/io_validation_mpmc 128 128 131072
+./$BIN_DIR/io_validation_mpmc 1024 1024 1048576
+./$BIN_DIR/io_validation_mpmc 32 128 131072
+./$BIN_DIR/io_validation_mpmc 128 32 131072
+./$BIN_DIR/io_validation_mpmc 1 128 131072
+./$BIN_DIR/io_validation_mpmc 128 1 131072
+./$BIN_DIR/io_validation_ticket 1 1 16
+./$BIN_DIR/io_validation_ticket 4 4 256
+./$BIN_DIR/io_validation_ticket 128 128 131072
+./$BIN_DIR/io_validation_ticket 1024 1024 131072
+./$BIN_DIR/io_validation_ticket 32 128 131072
+./$BIN_DIR/io_validation_ticket 128 32 131072
+./$BIN_DIR/io_validation_ticket 1 128 131072
+./$BIN_DIR/io_validation_ticket 128 1 131072
+./$BIN_DIR/io_validation_ticket_fifo 2 2
+./$BIN_DIR/io_validation_ticket_fifo 4 4
+./$BIN_DIR/io_validation_ticket_fifo 8 8
+./$BIN_DIR/io_validation_ticket_fifo 16 16
+./$BIN_DIR/io_validation_ticket_fifo 32 32
+./$BIN_DIR/io_validation_typed 1 1 16 1
+./$BIN_DIR/io_validation_typed 4 4 256 3
+./$BIN_DIR/io_validation_typed 4 4 256 3 1
+./$BIN_DIR/io_validation_typed 16 16 65536 64
+./$BIN_DIR/io_validation_typed 16 16 65536 100 1
+./$BIN_DIR/io_validation_typed 8 8 65536 0
+./$BIN_DIR/io_validation_typed 1 16 65536 7
+./$BIN_DIR/io_validation_typed 16 1 65536 2
+./$BIN_DIR/io_validation_sized 1 1 16 1 16
+./$BIN_DIR/io_validation_sized 4 4 256 3 24
+./$BIN_DIR/io_validation_sized 16 16 65536 64 16
+./$BIN_DIR/io_validation_sized 16 16 65536 100 128
+./$BIN_DIR/io_validation_sized 8 8 65536 0 48
+./$BIN_DIR/io_validation_sized 1 16 65536 7 8
+./$BIN_DIR/io_validation_sized 16 1 65536 0 100
+./$BIN_DIR/io_validation_zero_copy 1 1 16 1 16
+./$BIN_DIR/io_validation_zero_copy 4 4 256 3 24
+./$BIN_DIR/io_validation_zero_copy 16 16 65536 64 16
+./$BIN_DIR/io_validation_zero_copy 8 8 65536 0 48
+./$BIN_DIR/io_validation_zero_copy 1 16 65536 7 8
+./$BIN_DIR/io_validation_zero_copy 16 1 65536 0 100
+./$BIN_DIR/io_validation_allocator 1 1 16 1
+./$BIN_DIR/io_validation_allocator 16 16 65536 1
+./$BIN_DIR/io_validation_allocator 16 16 65536 64
+./$BIN_DIR/io_validation_allocator 8 8 65536 0
+./$BIN_DIR/io_validation_allocator 1 16 65536 0
+./$BIN_DIR/io_validation_no_alloc 1 1 16 1
+./$BIN_DIR/io_validation_no_alloc 16 16 65536 1
+./$BIN_DIR/io_validation_no_alloc 16 16 65536 64
+./$BIN_DIR/io_validation_no_alloc 1 16 65536 7
+./$BIN_DIR/io_validation_no_alloc 16 1 65536 3
+./$BIN_DIR/io_validation_no_alloc_no_futex 16 16 65536 1
+./$BIN_DIR/io_validation_no_alloc_no_futex 16 16 65536 64
 popd
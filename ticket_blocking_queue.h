@@ -0,0 +1,462 @@
+#ifndef C_FEK_TICKET_BLOCKING_QUEUE
+#define C_FEK_TICKET_BLOCKING_QUEUE
+
+/*
+	Author: Felipe Einsfeld Kersting
+
+	MIT License
+
+	Copyright (c) 2020 Felipe Kersting
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+
+	To use this blocking queue, define C_FEK_TICKET_BLOCKING_QUEUE_IMPLEMENTATION before including ticket_blocking_queue.h in one of
+	your source files.
+
+	To use this blocking queue, you must link your binary with pthread.
+
+	This is a variant of the blocking queue in blocking_queue.h that also serves blocked callers in FIFO order, but without fair
+	locks and without a global mutex.
+
+	Every _put/_take call takes a ticket from a monotonically increasing counter (one counter for producers, another one for
+	consumers). The ticket determines both the slot of the ring the caller will use and the 'turn' the slot must reach before the
+	caller can use it. Callers are thus served in the order they got their tickets, and callers with tickets for different slots
+	make progress in parallel. A caller whose turn has not come yet spins for a short while and then parks (on a futex shared by
+	the whole queue on Linux, with a bitset derived from its slot and turn so that a change of turn only wakes up a fraction of the
+	parked callers; on a shared cond on other platforms). Since every parked caller sleeps on the same futex, closing the queue
+	wakes all of them up at once.
+
+	The non-blocking _add/_poll calls only take a ticket if its slot is ready, so they never overtake blocked callers.
+
+	This blocking queue has the following properties/features:
+
+	- It has a fixed capacity, provided by the caller. The capacity is rounded up to the next power of two.
+	- It allows the caller to add elements to the queue via both a blocking call and a non-blocking call.
+	- It allows the caller to get elements from the queue via both a blocking call and a non-blocking call.
+	- If multiple callers are blocked adding/getting an element to/from the queue, they are served in FIFO order.
+
+	Unlike blocking_queue.h, there is no boundless mode. Also, every slot takes a whole cache line, so prefer small capacities.
+
+	Define C_FEK_TICKET_BLOCKING_QUEUE_NO_CRT if you don't want the C Runtime Library included. If this is defined, you must provide
+	implementations for the following functions:
+
+	void* malloc(unsigned int size)
+	void  free(void* block)
+
+	Define C_FEK_TICKET_BLOCKING_QUEUE_CACHE_LINE_SIZE to change the cache line size used to separate slots and counters
+	(defaults to 64).
+
+	For more information about the API, check the comments in the function signatures.
+
+	https://github.com/felipeek/c-fifo-blocking-queue
+*/
+
+#include "blocking_queue.h"
+
+#ifndef C_FEK_TICKET_BLOCKING_QUEUE_CACHE_LINE_SIZE
+#define C_FEK_TICKET_BLOCKING_QUEUE_CACHE_LINE_SIZE 64
+#endif
+
+// This structure is reserved for internal-use only
+typedef struct {
+	// For lap 'l', the slot is free for the producer when turn == 2 * l, and full for the consumer when turn == 2 * l + 1
+	unsigned int turn;
+	// Number of callers parked waiting for this slot's turn to change. A change of turn only wakes anybody up if it is not zero.
+	unsigned int waiters;
+	void* element;
+} __attribute__((aligned(C_FEK_TICKET_BLOCKING_QUEUE_CACHE_LINE_SIZE))) Ticket_Blocking_Queue_Slot;
+
+// This structure is reserved for internal-use only
+typedef struct {
+	// Next producer ticket
+	unsigned long long head __attribute__((aligned(C_FEK_TICKET_BLOCKING_QUEUE_CACHE_LINE_SIZE)));
+	// Next consumer ticket
+	unsigned long long tail __attribute__((aligned(C_FEK_TICKET_BLOCKING_QUEUE_CACHE_LINE_SIZE)));
+	// The ring of slots. Its capacity is always a power of two.
+	Ticket_Blocking_Queue_Slot* slots __attribute__((aligned(C_FEK_TICKET_BLOCKING_QUEUE_CACHE_LINE_SIZE)));
+	// The capacity of the ring
+	unsigned int queue_capacity;
+	// log2(queue_capacity)
+	unsigned int queue_shift;
+	// Indicates whether the queue was closed.
+	int closed;
+	// Bumped on every change of turn of a slot with parked callers, and when the queue is closed. Parked callers sleep on it.
+	unsigned int wake_generation;
+	// Number of active callers, plus TICKET_BLOCKING_QUEUE_CALLERS_CLOSED once 'ticket_blocking_queue_close' is waiting for them
+	// to leave. Updated atomically.
+	unsigned int active_callers __attribute__((aligned(C_FEK_TICKET_BLOCKING_QUEUE_CACHE_LINE_SIZE)));
+	// Set by the last caller to leave a closed queue
+	unsigned int active_callers_drained;
+#if !defined(__linux__)
+	// Mutex and cond used to park callers (and to wait for them to leave), on platforms without futexes
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+#endif
+} Ticket_Blocking_Queue;
+
+// Init the ticket blocking queue.
+// The capacity is given by 'capacity', which is rounded up to the next power of two. It must be > 0.
+// Returns 0 if success, -1 if error.
+int ticket_blocking_queue_init(Ticket_Blocking_Queue* bq, unsigned int capacity);
+// Adds an element to the queue
+// This function does NOT block the caller.
+// If the queue is full or there are producers blocked in '_put', this function will not add the new element. Instead, it will
+// return BQ_FULL.
+// Returns:
+// * 0 if success
+// * BQ_FULL if the there is no space in the queue
+// * BQ_CLOSED if the queue was closed
+int ticket_blocking_queue_add(Ticket_Blocking_Queue* bq, void* element);
+// Puts an element to the queue
+// If the queue is full, the caller is blocked until there is space in the queue for the new element.
+// FIFO order is guaranteed - blocked callers will be served in FIFO order. There is no starvation.
+// Returns:
+// * 0 if success
+// * BQ_CLOSED if the queue was closed while the call was blocked
+int ticket_blocking_queue_put(Ticket_Blocking_Queue* bq, void* element);
+// Poll an element from the queue
+// The element is stored in '*element'
+// This function does NOT block the caller.
+// If the queue is empty or there are consumers blocked in '_take', this function will not poll any element. Instead, it will
+// return BQ_EMPTY.
+// Returns:
+// * 0 if success
+// * BQ_EMPTY if the queue is empty
+// * BQ_CLOSED if the queue was closed
+int ticket_blocking_queue_poll(Ticket_Blocking_Queue* bq, void* element);
+// Take an element from the queue
+// The element is stored in '*element'
+// If the queue is empty, the caller is blocked until there is an element available to take.
+// FIFO order is guaranteed - blocked callers will be served in FIFO order. There is no starvation.
+// Returns:
+// * 0 if success
+// * BQ_CLOSED if the queue was closed while the call was blocked
+int ticket_blocking_queue_take(Ticket_Blocking_Queue* bq, void* element);
+// Closes the queue.
+// When the queue is closed, all _add/_put/_poll/_take calls will immediately return BQ_CLOSED if called.
+// Callers blocked in one of these calls are unblocked and receive BQ_CLOSED before this function returns: parked callers are all
+// woken up with a single wake-up, and this function then waits until the count of active callers drops to zero.
+// Elements still in the queue are discarded. After the queue is closed, it cannot be reopened again.
+// Calling this function multiple times is allowed.
+void ticket_blocking_queue_close(Ticket_Blocking_Queue* bq);
+// Destroys the queue, closing it first if needed.
+// Like 'blocking_queue_destroy', this function may be called while other threads are still calling the queue: closing waits until
+// every active caller (blocked, spinning or about to return) has left. No call may start after this function started.
+void ticket_blocking_queue_destroy(Ticket_Blocking_Queue* bq);
+
+#ifdef C_FEK_TICKET_BLOCKING_QUEUE_IMPLEMENTATION
+#if !defined(C_FEK_TICKET_BLOCKING_QUEUE_NO_CRT)
+#include <stdlib.h>
+#endif
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <limits.h>
+#endif
+
+// Number of iterations a caller spins on its slot's turn before parking
+#define TICKET_BLOCKING_QUEUE_SPIN_COUNT 128
+// Set in 'active_callers' by 'ticket_blocking_queue_close'
+#define TICKET_BLOCKING_QUEUE_CALLERS_CLOSED 0x80000000u
+
+static inline void ticket_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+int ticket_blocking_queue_init(Ticket_Blocking_Queue* bq, unsigned int capacity) {
+	if (capacity == 0 || capacity > 0x40000000u) {
+		return -1;
+	}
+
+#if !defined(__linux__)
+	if (pthread_mutex_init(&bq->mutex, NULL)) {
+		return -1;
+	}
+
+	if (pthread_cond_init(&bq->cond, NULL)) {
+		pthread_mutex_destroy(&bq->mutex);
+		return -1;
+	}
+#endif
+
+	bq->queue_capacity = 1;
+	bq->queue_shift = 0;
+	while (bq->queue_capacity < capacity) {
+		bq->queue_capacity <<= 1;
+		++bq->queue_shift;
+	}
+	bq->head = 0;
+	bq->tail = 0;
+	bq->closed = 0;
+	bq->wake_generation = 0;
+	bq->active_callers = 0;
+	bq->active_callers_drained = 0;
+	bq->slots = (Ticket_Blocking_Queue_Slot*)malloc(bq->queue_capacity * sizeof(Ticket_Blocking_Queue_Slot));
+	if (bq->slots == NULL) {
+#if !defined(__linux__)
+		pthread_mutex_destroy(&bq->mutex);
+		pthread_cond_destroy(&bq->cond);
+#endif
+		return -1;
+	}
+	for (unsigned int i = 0; i < bq->queue_capacity; ++i) {
+		bq->slots[i].turn = 0;
+		bq->slots[i].waiters = 0;
+	}
+
+	return 0;
+}
+
+// Gets the bit of the futex bitset used by callers parked waiting for 'slot' to reach 'turn'. Callers waiting for other slots or
+// other laps may share the bit, in which case they are woken up for nothing and park again.
+static inline unsigned int ticket_wake_bit(Ticket_Blocking_Queue* bq, Ticket_Blocking_Queue_Slot* slot, unsigned int turn) {
+	return 1u << (((unsigned int)(slot - bq->slots) + turn) & 31);
+}
+
+// Wakes up the callers parked waiting for 'slot' to reach 'turn'.
+// The store of the new turn must be seq_cst, pairing with the increment of 'waiters' in 'ticket_park':
+// either the parked caller sees the new turn, or we see it in 'waiters'.
+static void ticket_wake(Ticket_Blocking_Queue* bq, Ticket_Blocking_Queue_Slot* slot, unsigned int turn) {
+	if (__atomic_load_n(&slot->waiters, __ATOMIC_SEQ_CST) == 0) {
+		return;
+	}
+#if defined(__linux__)
+	__atomic_add_fetch(&bq->wake_generation, 1, __ATOMIC_SEQ_CST);
+	syscall(SYS_futex, &bq->wake_generation, FUTEX_WAKE_BITSET_PRIVATE, INT_MAX, NULL, NULL, ticket_wake_bit(bq, slot, turn));
+#else
+	(void)slot;
+	(void)turn;
+	pthread_mutex_lock(&bq->mutex);
+	pthread_cond_broadcast(&bq->cond);
+	pthread_mutex_unlock(&bq->mutex);
+#endif
+}
+
+// Parks the caller until 'slot' reaches 'turn' or the queue is closed.
+static void ticket_park(Ticket_Blocking_Queue* bq, Ticket_Blocking_Queue_Slot* slot, unsigned int turn) {
+	__atomic_add_fetch(&slot->waiters, 1, __ATOMIC_SEQ_CST);
+#if defined(__linux__)
+	unsigned int bit = ticket_wake_bit(bq, slot, turn);
+	while (1) {
+		// The generation is read before the checks: if it changes after them, the futex does not put us to sleep
+		unsigned int generation = __atomic_load_n(&bq->wake_generation, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&slot->turn, __ATOMIC_SEQ_CST) == turn || __atomic_load_n(&bq->closed, __ATOMIC_SEQ_CST)) {
+			break;
+		}
+		syscall(SYS_futex, &bq->wake_generation, FUTEX_WAIT_BITSET_PRIVATE, generation, NULL, NULL, bit);
+	}
+#else
+	pthread_mutex_lock(&bq->mutex);
+	while (__atomic_load_n(&slot->turn, __ATOMIC_SEQ_CST) != turn && !__atomic_load_n(&bq->closed, __ATOMIC_SEQ_CST)) {
+		pthread_cond_wait(&bq->cond, &bq->mutex);
+	}
+	pthread_mutex_unlock(&bq->mutex);
+#endif
+	__atomic_sub_fetch(&slot->waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+// Unregisters the caller. The last caller to leave a closed queue wakes up the closer.
+static void ticket_leave(Ticket_Blocking_Queue* bq) {
+	// Only the last caller to leave after 'ticket_blocking_queue_close' started waiting sees exactly the flag
+	if (__atomic_sub_fetch(&bq->active_callers, 1, __ATOMIC_SEQ_CST) != TICKET_BLOCKING_QUEUE_CALLERS_CLOSED) {
+		return;
+	}
+#if defined(__linux__)
+	__atomic_store_n(&bq->active_callers_drained, 1, __ATOMIC_RELEASE);
+	syscall(SYS_futex, &bq->active_callers_drained, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+	pthread_mutex_lock(&bq->mutex);
+	bq->active_callers_drained = 1;
+	pthread_cond_broadcast(&bq->cond);
+	pthread_mutex_unlock(&bq->mutex);
+#endif
+}
+
+// Registers the caller as active. Returns BQ_CLOSED (and unregisters it) if the queue is closed.
+// 'ticket_blocking_queue_close' sets its flag in 'active_callers' before anything else, so a single atomic operation tells whether
+// the closer will wait for this caller.
+static int ticket_enter(Ticket_Blocking_Queue* bq) {
+	if (__atomic_add_fetch(&bq->active_callers, 1, __ATOMIC_SEQ_CST) & TICKET_BLOCKING_QUEUE_CALLERS_CLOSED) {
+		ticket_leave(bq);
+		return BQ_CLOSED;
+	}
+	return 0;
+}
+
+// Waits until 'slot' reaches 'turn'. Returns BQ_CLOSED if the queue is closed in the meantime.
+static int ticket_wait_turn(Ticket_Blocking_Queue* bq, Ticket_Blocking_Queue_Slot* slot, unsigned int turn) {
+	for (unsigned int i = 0; i < TICKET_BLOCKING_QUEUE_SPIN_COUNT; ++i) {
+		if (__atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE) == turn) {
+			return 0;
+		}
+		ticket_cpu_relax();
+	}
+	while (1) {
+		if (__atomic_load_n(&bq->closed, __ATOMIC_ACQUIRE)) {
+			return BQ_CLOSED;
+		}
+		if (__atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE) == turn) {
+			return 0;
+		}
+		ticket_park(bq, slot, turn);
+	}
+}
+
+void ticket_blocking_queue_close(Ticket_Blocking_Queue* bq) {
+	// From now on, new callers leave right away. Callers that were already active are waited for below.
+	unsigned int active_callers = __atomic_or_fetch(&bq->active_callers, TICKET_BLOCKING_QUEUE_CALLERS_CLOSED, __ATOMIC_SEQ_CST);
+
+	__atomic_store_n(&bq->closed, 1, __ATOMIC_SEQ_CST);
+	// Parked callers all sleep on 'wake_generation', so a single wake-up reaches all of them, no matter the slot they wait for
+#if defined(__linux__)
+	__atomic_add_fetch(&bq->wake_generation, 1, __ATOMIC_SEQ_CST);
+	syscall(SYS_futex, &bq->wake_generation, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+	pthread_mutex_lock(&bq->mutex);
+	pthread_cond_broadcast(&bq->cond);
+	pthread_mutex_unlock(&bq->mutex);
+#endif
+
+	// If callers are still active, the last one to leave sets 'active_callers_drained'
+	if (active_callers == TICKET_BLOCKING_QUEUE_CALLERS_CLOSED) {
+		return;
+	}
+#if defined(__linux__)
+	while (!__atomic_load_n(&bq->active_callers_drained, __ATOMIC_ACQUIRE)) {
+		syscall(SYS_futex, &bq->active_callers_drained, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+	}
+#else
+	pthread_mutex_lock(&bq->mutex);
+	while (!bq->active_callers_drained) {
+		pthread_cond_wait(&bq->cond, &bq->mutex);
+	}
+	pthread_mutex_unlock(&bq->mutex);
+#endif
+}
+
+void ticket_blocking_queue_destroy(Ticket_Blocking_Queue* bq) {
+	ticket_blocking_queue_close(bq);
+	free(bq->slots);
+#if !defined(__linux__)
+	pthread_mutex_destroy(&bq->mutex);
+	pthread_cond_destroy(&bq->cond);
+#endif
+}
+
+int ticket_blocking_queue_put(Ticket_Blocking_Queue* bq, void* element) {
+	if (ticket_enter(bq)) {
+		return BQ_CLOSED;
+	}
+
+	unsigned long long ticket = __atomic_fetch_add(&bq->head, 1, __ATOMIC_RELAXED);
+	Ticket_Blocking_Queue_Slot* slot = &bq->slots[ticket & (bq->queue_capacity - 1)];
+	unsigned int turn = (unsigned int)(ticket >> bq->queue_shift) * 2;
+	if (ticket_wait_turn(bq, slot, turn)) {
+		ticket_leave(bq);
+		return BQ_CLOSED;
+	}
+	slot->element = element;
+	__atomic_store_n(&slot->turn, turn + 1, __ATOMIC_SEQ_CST);
+	ticket_wake(bq, slot, turn + 1);
+	ticket_leave(bq);
+	return 0;
+}
+
+int ticket_blocking_queue_take(Ticket_Blocking_Queue* bq, void* element) {
+	if (ticket_enter(bq)) {
+		return BQ_CLOSED;
+	}
+
+	unsigned long long ticket = __atomic_fetch_add(&bq->tail, 1, __ATOMIC_RELAXED);
+	Ticket_Blocking_Queue_Slot* slot = &bq->slots[ticket & (bq->queue_capacity - 1)];
+	unsigned int turn = (unsigned int)(ticket >> bq->queue_shift) * 2 + 1;
+	if (ticket_wait_turn(bq, slot, turn)) {
+		ticket_leave(bq);
+		return BQ_CLOSED;
+	}
+	*(void**)element = slot->element;
+	__atomic_store_n(&slot->turn, turn + 1, __ATOMIC_SEQ_CST);
+	ticket_wake(bq, slot, turn + 1);
+	ticket_leave(bq);
+	return 0;
+}
+
+int ticket_blocking_queue_add(Ticket_Blocking_Queue* bq, void* element) {
+	if (ticket_enter(bq)) {
+		return BQ_CLOSED;
+	}
+
+	unsigned long long ticket = __atomic_load_n(&bq->head, __ATOMIC_ACQUIRE);
+	while (1) {
+		Ticket_Blocking_Queue_Slot* slot = &bq->slots[ticket & (bq->queue_capacity - 1)];
+		unsigned int turn = (unsigned int)(ticket >> bq->queue_shift) * 2;
+		if (__atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE) == turn) {
+			if (__atomic_compare_exchange_n(&bq->head, &ticket, ticket + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				slot->element = element;
+				__atomic_store_n(&slot->turn, turn + 1, __ATOMIC_SEQ_CST);
+				ticket_wake(bq, slot, turn + 1);
+				ticket_leave(bq);
+				return 0;
+			}
+		} else {
+			unsigned long long previous = ticket;
+			ticket = __atomic_load_n(&bq->head, __ATOMIC_ACQUIRE);
+			if (ticket == previous) {
+				ticket_leave(bq);
+				return BQ_FULL;
+			}
+		}
+	}
+}
+
+int ticket_blocking_queue_poll(Ticket_Blocking_Queue* bq, void* element) {
+	if (ticket_enter(bq)) {
+		return BQ_CLOSED;
+	}
+
+	unsigned long long ticket = __atomic_load_n(&bq->tail, __ATOMIC_ACQUIRE);
+	while (1) {
+		Ticket_Blocking_Queue_Slot* slot = &bq->slots[ticket & (bq->queue_capacity - 1)];
+		unsigned int turn = (unsigned int)(ticket >> bq->queue_shift) * 2 + 1;
+		if (__atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE) == turn) {
+			if (__atomic_compare_exchange_n(&bq->tail, &ticket, ticket + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				*(void**)element = slot->element;
+				__atomic_store_n(&slot->turn, turn + 1, __ATOMIC_SEQ_CST);
+				ticket_wake(bq, slot, turn + 1);
+				ticket_leave(bq);
+				return 0;
+			}
+		} else {
+			unsigned long long previous = ticket;
+			ticket = __atomic_load_n(&bq->tail, __ATOMIC_ACQUIRE);
+			if (ticket == previous) {
+				ticket_leave(bq);
+				return BQ_EMPTY;
+			}
+		}
+	}
+}
+
+#endif
+#endif